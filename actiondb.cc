@@ -16,6 +16,8 @@
 #include "actiondb.h"
 #include "main.h"
 #include "win.h"
+#include "spawn.h"
+#include "latency.h"
 #include <glibmm/i18n.h>
 
 #include <iostream>
@@ -49,6 +51,9 @@ template<class Archive> void Action::serialize(Archive & ar, const unsigned int
 template<class Archive> void Command::serialize(Archive & ar, const unsigned int version) {
 	ar & boost::serialization::base_object<Action>(*this);
 	ar & cmd;
+	if (version == 0) return;
+	ar & max_running;
+	ar & debounce;
 }
 
 template<class Archive> void ModAction::serialize(Archive & ar, const unsigned int version) {
@@ -119,14 +124,11 @@ template<class Archive> void StrokeInfo::serialize(Archive & ar, const unsigned
 using namespace std;
 
 void Command::run() {
-	pid_t pid = fork();
-	switch (pid) {
-		case 0:
-			execlp("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
-			exit(1);
-		case -1:
-			printf(_("Error: can't execute command \"%s\": fork() failed\n"), cmd.c_str());
-	}
+	run(std::vector<std::string>());
+}
+
+void Command::run(const std::vector<std::string> &env) {
+	spawn_command(cmd, env, this, max_running, debounce);
 }
 
 ButtonInfo Button::get_button_info() const {
@@ -191,25 +193,32 @@ template<class Archive> void ActionDB::save(Archive & ar, const unsigned int ver
 Source<bool> action_dummy;
 
 void update_actions() {
-	action_dummy.set(false);
+	actions.get_root()->update_clicks();
+	action_dummy.notify();
+}
+
+bool load_actions(const std::string &filename) {
+	try {
+		ifstream ifs(filename.c_str(), ios::binary);
+		if (ifs.fail())
+			return false;
+		boost::archive::text_iarchive ia(ifs);
+		ia >> actions;
+		actions.get_root()->update_clicks();
+		if (verbosity >= 2)
+			printf("Loaded actions.\n");
+		return true;
+	} catch (exception &e) {
+		printf(_("Error: Couldn't read action database: %s.\n"), e.what());
+		return false;
+	}
 }
 
 void ActionDBWatcher::init() {
 	std::string filename = config_dir+"actions";
 	for (const char **v = actions_versions; *v; v++)
 		if (is_file(filename + *v)) {
-			filename += *v;
-			try {
-				ifstream ifs(filename.c_str(), ios::binary);
-				if (!ifs.fail()) {
-					boost::archive::text_iarchive ia(ifs);
-					ia >> actions;
-					if (verbosity >= 2)
-						printf("Loaded actions.\n");
-				}
-			} catch (exception &e) {
-				printf(_("Error: Couldn't read action database: %s.\n"), e.what());
-			}
+			load_actions(filename + *v);
 			break;
 		}
 	watch(action_dummy);
@@ -306,25 +315,107 @@ void ActionListDiff::all_strokes(std::list<RStroke> &strokes) const {
 		i->all_strokes(strokes);
 }
 
+int Ranking::max_size = 10;
+
+// Among equal scores, the candidate found last comes first
+void Ranking::add(Unique *id, int index, double score) {
+	int n = n_candidates < max_size ? n_candidates + 1 : max_size;
+	int pos = n_candidates;
+	while (pos && candidates[pos-1].score <= score)
+		pos--;
+	if (pos >= n)
+		return;
+	for (int i = n-1; i > pos; i--)
+		candidates[i] = candidates[i-1];
+	Candidate &c = candidates[pos];
+	c.id = id;
+	c.index = index;
+	c.score = score;
+	n_candidates = n;
+}
+
+void Ranking::get_candidates(std::vector<Entry> &r) const {
+	r.clear();
+	const ActionListDiff *l = actions.get_action_list(app);
+	boost::shared_ptr<std::map<Unique *, StrokeSet> > strokes = l->get_strokes();
+	for (int i = 0; i < n_candidates; i++) {
+		const Candidate &c = candidates[i];
+		std::map<Unique *, StrokeSet>::const_iterator j = strokes->find(c.id);
+		if (j == strokes->end() || c.index >= (int)j->second.size())
+			continue;
+		Entry e;
+		e.score = c.score;
+		StrokeSet::const_iterator k = j->second.begin();
+		std::advance(k, c.index);
+		e.stroke = *k;
+		e.name = l->get_info(c.id)->name;
+		r.push_back(e);
+	}
+}
+
+void ActionListDiff::update_clicks() {
+	clicks.clear();
+	boost::shared_ptr<std::map<Unique *, StrokeSet> > strokes = get_strokes();
+	for (std::map<Unique *, StrokeSet>::const_iterator i = strokes->begin(); i!=strokes->end(); i++) {
+		int k = 0;
+		for (StrokeSet::iterator j = i->second.begin(); j!=i->second.end(); j++, k++)
+			if (*j && !(*j)->stroke) {
+				ClickMatch m = { i->first, k, *j };
+				clicks[ClickKey(**j)].push_back(m);
+			}
+	}
+	for (std::list<ActionListDiff>::iterator i = children.begin(); i != children.end(); i++)
+		i->update_clicks();
+}
+
+const ActionListDiff::ClickList *ActionListDiff::find_clicks(const Stroke &s) const {
+	std::map<ClickKey, ClickList>::const_iterator i = clicks.find(ClickKey(s));
+	return i == clicks.end() ? nullptr : &i->second;
+}
+
 RAction ActionListDiff::handle(RStroke s, RRanking &r) const {
 	if (!s)
 		return RAction();
+	LATENCY_SCOPE(LatencyFilter);
 	r.reset(new Ranking);
 	r->stroke = s;
-	r->score = 0.0;
+	if (app)
+		r->app = name;
+	if (!s->stroke) {
+		// Same result as the loop below, see find_clicks()
+		const ClickList *l = find_clicks(*s);
+		if (l) {
+			RStrokeInfo si = get_info(l->front().id);
+			r->score = 1.0;
+			r->name = si->name;
+			r->action = si->action;
+			r->best_stroke = l->front().stroke;
+			for (ClickList::const_iterator i = l->begin(); i != l->end(); i++)
+				r->add(i->id, i->index, 1.0);
+		}
+		if (!r->action && s->trivial())
+			return RAction(new Click);
+		if (verbosity >= 1) {
+			if (r->action)
+				printf("Executing Action %s\n", r->name.c_str());
+			else
+				printf("Couldn't find matching stroke.\n");
+		}
+		return r->action;
+	}
 	boost::shared_ptr<std::map<Unique *, StrokeSet> > strokes = get_strokes();
 	for (std::map<Unique *, StrokeSet>::const_iterator i = strokes->begin(); i!=strokes->end(); i++) {
-		for (StrokeSet::iterator j = i->second.begin(); j!=i->second.end(); j++) {
+		int k = 0;
+		for (StrokeSet::iterator j = i->second.begin(); j!=i->second.end(); j++, k++) {
 			double score;
 			int match = Stroke::compare(s, *j, score);
 			if (match < 0)
 				continue;
-			RStrokeInfo si = get_info(i->first);
-			r->r.insert(pair<double, pair<std::string, RStroke> >
-					(score, pair<std::string, RStroke>(si->name, *j)));
+			r->add(i->first, k, score);
 			if (score > r->score) {
 				r->score = score;
 				if (match) {
+					RStrokeInfo si = get_info(i->first);
 					r->name = si->name;
 					r->action = si->action;
 					r->best_stroke = *j;
@@ -344,46 +435,51 @@ RAction ActionListDiff::handle(RStroke s, RRanking &r) const {
 	return r->action;
 }
 
-void ActionListDiff::handle_advanced(RStroke s, std::map<guint, RAction> &as,
-		std::map<guint, RRanking> &rs, int b1, int b2) const {
+bool ActionListDiff::handle_advanced(RStroke s, guint b, RAction &a, RRanking &r, int b1, int b2) const {
+	a.reset();
+	r.reset();
 	if (!s)
-		return;
+		return false;
+	LATENCY_SCOPE(LatencyFilter);
+	bool found = false;
+	// Work on a copy, s may be shared with queries for other buttons
+	RStroke t(new Stroke(*s));
 	boost::shared_ptr<std::map<Unique *, StrokeSet> > strokes = get_strokes();
 	for (std::map<Unique *, StrokeSet>::const_iterator i = strokes->begin(); i!=strokes->end(); i++) {
-		for (StrokeSet::iterator j = i->second.begin(); j!=i->second.end(); j++) {
-			int b = (*j)->button;
-			if (!s->timeout && !b)
+		int k = 0;
+		for (StrokeSet::iterator j = i->second.begin(); j!=i->second.end(); j++, k++) {
+			int sb = (*j)->button;
+			if ((sb == b1 ? b2 : sb) != (int)b)
 				continue;
-			s->button = b;
+			if (!t->timeout && !sb)
+				continue;
+			t->button = sb;
 			double score;
-			int match = Stroke::compare(s, *j, score);
+			int match = Stroke::compare(t, *j, score);
 			if (match < 0)
 				continue;
-			Ranking *r;
-			if (b == b1)
-				b = b2;
-			if (rs.count(b)) {
-				r = rs[b].get();
-			} else {
-				r = new Ranking;
-				rs[b].reset(r);
-				r->stroke = RStroke(new Stroke(*s));
+			if (!r) {
+				r.reset(new Ranking);
+				r->stroke = RStroke(new Stroke(*t));
 				r->score = -1;
+				if (app)
+					r->app = name;
 			}
-			RStrokeInfo si = get_info(i->first);
-			r->r.insert(pair<double, pair<std::string, RStroke> >
-					(score, pair<std::string, RStroke>(si->name, *j)));
+			r->add(i->first, k, score);
 			if (score > r->score) {
 				r->score = score;
 				if (match) {
+					RStrokeInfo si = get_info(i->first);
 					r->name = si->name;
 					r->action = si->action;
 					r->best_stroke = *j;
-					as[b] = si->action;
+					a = si->action;
+					found = true;
 				}
 			}
 		}
 	}
+	return found;
 }
 
 ActionListDiff::~ActionListDiff() {
@@ -18,6 +18,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/split_member.hpp>
@@ -66,12 +67,19 @@ public:
 class Command : public Action {
 	friend class boost::serialization::access;
 	template<class Archive> void serialize(Archive & ar, const unsigned int version);
-	Command(const std::string &c) : cmd(c) {}
+	Command(const std::string &c, int m, int d) : cmd(c), max_running(m), debounce(d) {}
 public:
 	std::string cmd;
-	Command() {}
-	static RCommand create(const std::string &c) { return RCommand(new Command(c)); }
+	// Instances allowed to run at a time and the time (ms) within which a
+	// repeated trigger is ignored, 0 for no limit
+	int max_running;
+	int debounce;
+	Command() : max_running(0), debounce(0) {}
+	static RCommand create(const std::string &c, int max_running = 0, int debounce = 0) {
+		return RCommand(new Command(c, max_running, debounce));
+	}
 	virtual void run();
+	void run(const std::vector<std::string> &env);
 	virtual const Glib::ustring get_label() const { return cmd; }
 };
 
@@ -105,6 +113,7 @@ public:
 	virtual RModifiers prepare();
 	virtual const Glib::ustring get_label() const;
 };
+BOOST_CLASS_VERSION(Command, 1)
 BOOST_CLASS_VERSION(SendKey, 1)
 #define IS_KEY(act) (act && dynamic_cast<SendKey *>(act.get()))
 
@@ -211,11 +220,35 @@ class Ranking {
 	static bool show(RRanking r);
 	int x, y;
 public:
+	// Where handle() or handle_advanced() found a candidate: the action and
+	// the position of the stroke in its StrokeSet
+	struct Candidate {
+		Unique *id;
+		int index;
+		double score;
+	};
+	struct Entry {
+		double score;
+		RStroke stroke;
+		std::string name;
+	};
 	RStroke stroke, best_stroke;
 	RAction action;
 	double score;
 	std::string name;
-	std::multimap<double, std::pair<std::string, RStroke> > r;
+	// The list that was searched, see ActionDB::get_action_list
+	std::string app;
+
+	static const int MAX_SIZE = 32;
+	static int max_size;
+	// The best max_size candidates, best first
+	Candidate candidates[MAX_SIZE];
+	int n_candidates;
+
+	Ranking() : score(0.0), n_candidates(0) {}
+	void add(Unique *id, int index, double score);
+	// Looks up the candidates that are still in the list, for the History tab
+	void get_candidates(std::vector<Entry> &r) const;
 	static void queue_show(RRanking r, RTriple e);
 };
 
@@ -237,6 +270,32 @@ class ActionListDiff {
 	std::list<Unique *> order;
 	std::list<ActionListDiff> children;
 
+	// Strokes without a path (clicks and bare button/modifier combinations)
+	// can only ever match each other, and always with the same score, so we
+	// look them up in a table instead of comparing against every stroke.
+	// The tables are rebuilt by update_actions(), so that handle() never
+	// writes to the list.
+	struct ClickKey {
+		int trigger, button;
+		unsigned int modifiers;
+		bool timeout;
+		ClickKey(const Stroke &s) : trigger(s.trigger), button(s.button), modifiers(s.modifiers), timeout(s.timeout) {}
+		bool operator<(const ClickKey &k) const {
+			if (trigger != k.trigger) return trigger < k.trigger;
+			if (button != k.button) return button < k.button;
+			if (modifiers != k.modifiers) return modifiers < k.modifiers;
+			return timeout < k.timeout;
+		}
+	};
+	struct ClickMatch {
+		Unique *id;
+		int index; // in the StrokeSet of id
+		RStroke stroke;
+	};
+	typedef std::vector<ClickMatch> ClickList;
+	std::map<ClickKey, ClickList> clicks;
+	const ClickList *find_clicks(const Stroke &s) const;
+
 	void update_order() {
 		int j = 0;
 		for (std::list<Unique *>::iterator i = order.begin(); i != order.end(); i++, j++) {
@@ -269,6 +328,7 @@ public:
 	iterator end() { return children.end(); }
 
 	RStrokeInfo get_info(Unique *id, bool *deleted = 0, bool *stroke = 0, bool *name = 0, bool *action = 0) const;
+	void update_clicks();
 	int order_size() const { return order.size(); }
 	int size_rec() const {
 		int size = added.size();
@@ -373,8 +433,9 @@ public:
 	}
 	void all_strokes(std::list<RStroke> &strokes) const;
 	RAction handle(RStroke s, RRanking &r) const;
-	// b1 is always reported as b2
-	void handle_advanced(RStroke s, std::map<guint, RAction> &a, std::map<guint, RRanking> &r, int b1, int b2) const;
+	// Matches s against the strokes for button b, where b1 counts as b2.
+	// Doesn't modify s, so queries for different buttons are independent.
+	bool handle_advanced(RStroke s, guint b, RAction &a, RRanking &r, int b1, int b2) const;
 
 	~ActionListDiff();
 };
@@ -416,4 +477,5 @@ public:
 
 extern ActionDB actions;
 void update_actions();
+bool load_actions(const std::string &filename);
 #endif
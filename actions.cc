@@ -131,6 +131,7 @@ Actions::Actions() :
 	Gtk::Button *button_add, *button_add_app, *button_add_group;
 	widgets->get_widget("button_add_action", button_add);
 	widgets->get_widget("button_delete_action", button_delete);
+	widgets->get_widget("button_limits", button_limits);
 	widgets->get_widget("button_record", button_record);
 	widgets->get_widget("button_add_app", button_add_app);
 	widgets->get_widget("button_add_group", button_add_group);
@@ -141,6 +142,7 @@ Actions::Actions() :
 	widgets->get_widget("vpaned_apps", vpaned_apps);
 	button_record->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_button_record));
 	button_delete->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_button_delete));
+	button_limits->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_button_limits));
 	button_add->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_button_new));
 	button_add_app->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_add_app));
 	button_add_group->signal_clicked().connect(sigc::mem_fun(*this, &Actions::on_add_group));
@@ -155,7 +157,9 @@ Actions::Actions() :
 	tv.get_selection()->set_mode(Gtk::SELECTION_MULTIPLE);
 
 	int n;
-	n = tv.append_column(_("Stroke"), cols.stroke);
+	Gtk::CellRendererPixbuf *stroke_renderer = Gtk::manage(new Gtk::CellRendererPixbuf);
+	n = tv.append_column(_("Stroke"), *stroke_renderer);
+	tv.get_column(n-1)->set_cell_data_func(*stroke_renderer, sigc::mem_fun(*this, &Actions::on_cell_data_stroke));
 	tv.get_column(n-1)->set_sort_column(cols.id);
 	tm->set_sort_func(cols.id, sigc::mem_fun(*this, &Actions::compare_ids));
 	tm->set_default_sort_func(sigc::mem_fun(*this, &Actions::compare_ids));
@@ -240,6 +244,14 @@ void Actions::load_app_list(const Gtk::TreeNodeChildren &ch, ActionListDiff *act
 		load_app_list(row.children(), &(*i));
 }
 
+void Actions::on_cell_data_stroke(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter) {
+	RStroke s = (*iter)[cols.stroke];
+	bool bold = (*iter)[cols.stroke_bold];
+	Gtk::CellRendererPixbuf *renderer = dynamic_cast<Gtk::CellRendererPixbuf *>(cell);
+	if (renderer)
+		renderer->property_pixbuf() = s ? s->draw(STROKE_SIZE, bold ? 4.0 : 2.0) : Stroke::drawEmpty(STROKE_SIZE);
+}
+
 void Actions::on_cell_data_name(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter) {
 	bool bold = (*iter)[cols.name_bold];
 	bool deactivated = (*iter)[cols.deactivated];
@@ -511,6 +523,31 @@ void Actions::on_button_delete() {
 	update_counts();
 }
 
+void Actions::on_button_limits() {
+	Gtk::TreeRow row = get_selected_row();
+	RCommand cmd = boost::dynamic_pointer_cast<Command>(action_list->get_info(row[cols.id])->action);
+	if (!cmd)
+		return;
+
+	Gtk::MessageDialog *dialog;
+	widgets->get_widget("dialog_limits", dialog);
+	Gtk::SpinButton *spin_max_running, *spin_debounce;
+	widgets->get_widget("spin_max_running", spin_max_running);
+	widgets->get_widget("spin_debounce", spin_debounce);
+	spin_max_running->set_value(cmd->max_running);
+	spin_debounce->set_value(cmd->debounce);
+	dialog->show();
+	spin_max_running->grab_focus();
+	bool ok = dialog->run() == 1;
+	dialog->hide();
+	if (!ok)
+		return;
+
+	action_list->set_action(row[cols.id], Command::create(cmd->cmd, spin_max_running->get_value_as_int(), spin_debounce->get_value_as_int()));
+	update_row(row);
+	update_actions();
+}
+
 void Actions::on_cell_data_apps(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter) {
 	ActionListDiff *as = (*iter)[ca.actions];
 	Gtk::CellRendererText *renderer = dynamic_cast<Gtk::CellRendererText *>(cell);
@@ -681,8 +718,8 @@ void Actions::update_action_list() {
 void Actions::update_row(const Gtk::TreeRow &row) {
 	bool deleted, stroke, name, action;
 	RStrokeInfo si = action_list->get_info(row[cols.id], &deleted, &stroke, &name, &action);
-	row[cols.stroke] = !si->strokes.empty() && *si->strokes.begin() ? 
-		(*si->strokes.begin())->draw(STROKE_SIZE, stroke ? 4.0 : 2.0) : Stroke::drawEmpty(STROKE_SIZE);
+	row[cols.stroke] = si->strokes.empty() ? RStroke() : *si->strokes.begin();
+	row[cols.stroke_bold] = stroke;
 	row[cols.name] = si->name;
 	row[cols.type] = si->action ? type_info_to_name(&typeid(*si->action)) : "";
 	row[cols.arg]  = si->action ? si->action->get_label() : "";
@@ -789,6 +826,7 @@ void Actions::on_selection_changed() {
 	int n = tv.get_selection()->count_selected_rows();
 	button_record->set_sensitive(n == 1);
 	button_delete->set_sensitive(n >= 1);
+	button_limits->set_sensitive(n == 1 && from_name(get_selected_row()[cols.type]) == COMMAND);
 	bool resettable = false;
 	if (n) {
 		std::vector<Gtk::TreePath> paths = tv.get_selection()->get_selected_rows();
@@ -859,7 +897,11 @@ void Actions::on_text_edited(const gchar *path, const gchar *new_text) {
 	Gtk::TreeRow row(*tm->get_iter(path));
 	Type type = from_name(row[cols.type]);
 	if (type == COMMAND) {
-		action_list->set_action(row[cols.id], Command::create(new_text));
+		RCommand cmd = boost::dynamic_pointer_cast<Command>(action_list->get_info(row[cols.id])->action);
+		if (cmd)
+			action_list->set_action(row[cols.id], Command::create(new_text, cmd->max_running, cmd->debounce));
+		else
+			action_list->set_action(row[cols.id], Command::create(new_text));
 	} else if (type == TEXT) {
 		action_list->set_action(row[cols.id], SendText::create(new_text));
 	} else return;
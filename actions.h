@@ -17,6 +17,7 @@
 #define __ACTIONS_H__
 
 #include <gtkmm.h>
+#include "gesture.h"
 
 class Unique;
 class Win;
@@ -37,6 +38,7 @@ public:
 	Actions();
 private:
 	void on_button_delete();
+	void on_button_limits();
 	void on_button_new();
 	void on_button_record();
 	void on_selection_changed();
@@ -45,6 +47,7 @@ private:
 	void on_something_editing_started(Gtk::CellEditable* editable, const Glib::ustring& path);
 	void on_something_editing_canceled();
 	void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column);
+	void on_cell_data_stroke(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter);
 	void on_cell_data_name(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter);
 	void on_cell_data_type(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter);
 public:
@@ -80,12 +83,13 @@ private:
 	public:
 		ModelColumns() {
 			add(stroke); add(name); add(type); add(arg); add(cmd_save); add(id);
-			add(name_bold); add(action_bold); add(deactivated);
+			add(stroke_bold); add(name_bold); add(action_bold); add(deactivated);
 		}
-		Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf> > stroke;
+		// Drawn through the thumbnail cache when the row is displayed
+		Gtk::TreeModelColumn<RStroke> stroke;
 		Gtk::TreeModelColumn<Glib::ustring> name, type, arg, cmd_save;
 		Gtk::TreeModelColumn<Unique *> id;
-		Gtk::TreeModelColumn<bool> name_bold, action_bold;
+		Gtk::TreeModelColumn<bool> stroke_bold, name_bold, action_bold;
 		Gtk::TreeModelColumn<bool> deactivated;
 	};
 	class Store : public Gtk::ListStore {
@@ -138,7 +142,7 @@ private:
 
 	Glib::RefPtr<Gtk::ListStore> type_store;
 
-	Gtk::Button *button_record, *button_delete, *button_remove_app, *button_reset_actions;
+	Gtk::Button *button_record, *button_delete, *button_limits, *button_remove_app, *button_reset_actions;
 	Gtk::CheckButton *check_show_deleted;
 	Gtk::Expander *expander_apps;
 	Gtk::VPaned *vpaned_apps;
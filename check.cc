@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+// easystroke-check: checks that unpremultiply() gives exactly the same
+// pixels as the plain per-pixel version and times both on stroke sized
+// pictures.  Run by 'make check'.
+#include "unpremultiply.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Fills a w x h picture with premultiplied pixels in runs of transparent,
+// opaque and translucent ones, so that both the SSE2 fast paths and the
+// fallback get exercised.  The padding at the end of each row is random as
+// well and must be left alone.
+static void random_picture(GRand *rand, std::vector<guint8> &buf, int w, int h, int stride) {
+	buf.resize(stride * h);
+	for (std::vector<guint8>::iterator i = buf.begin(); i != buf.end(); i++)
+		*i = g_rand_int_range(rand, 0, 256);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w;) {
+			int kind = g_rand_int_range(rand, 0, 3);
+			for (int n = g_rand_int_range(rand, 1, 9); n && x < w; n--, x++) {
+				guint8 *p = &buf[y*stride + 4*x];
+				int a = kind == 0 ? 0 : kind == 1 ? 255 : g_rand_int_range(rand, 0, 256);
+				p[3] = a;
+				for (int c = 0; c < 3; c++)
+					p[c] = g_rand_int_range(rand, 0, a + 1);
+			}
+		}
+}
+
+static gint64 time_unpremultiply(void (*f)(guint8 *, int, int, int), const std::vector<guint8> &src, int w, int h, int rounds) {
+	std::vector<guint8> buf(src.size());
+	gint64 elapsed = 0;
+	for (int i = 0; i < rounds; i++) {
+		std::copy(src.begin(), src.end(), buf.begin());
+		gint64 start = g_get_monotonic_time();
+		f(&buf[0], w, h, 4*w);
+		elapsed += g_get_monotonic_time() - start;
+	}
+	return elapsed;
+}
+
+int main() {
+#ifdef __SSE2__
+	printf("Fast path:    SSE2\n");
+#else
+	printf("Fast path:    none, both versions are the same\n");
+#endif
+	GRand *rand = g_rand_new_with_seed(1);
+	const int N = 10000;
+	int bad = 0;
+	std::vector<guint8> a, b;
+	for (int i = 0; i < N; i++) {
+		int w = g_rand_int_range(rand, 1, 70);
+		int h = g_rand_int_range(rand, 1, 8);
+		int stride = 4*w + 4*g_rand_int_range(rand, 0, 3);
+		random_picture(rand, a, w, h, stride);
+		b = a;
+		unpremultiply(&a[0], w, h, stride);
+		unpremultiply_scalar(&b[0], w, h, stride);
+		if (a != b)
+			bad++;
+	}
+	printf("Equivalence:  %s (%d of %d pictures differ)\n", bad ? "FAILED" : "ok", bad, N);
+
+	// A stroke picture is mostly transparent with an opaque line and some
+	// antialiasing at its edges
+	const int S = 64, rounds = 2000; // STROKE_SIZE
+	std::vector<guint8> stroke(4*S*S, 0);
+	for (int y = 0; y < S; y++)
+		for (int x = 0; x < S; x++) {
+			int d = abs(x - y);
+			guint8 *p = &stroke[4*(y*S + x)];
+			p[3] = d < 2 ? 255 : d < 3 ? 128 : 0;
+			p[1] = p[3];
+		}
+	random_picture(rand, a, S, S, 4*S);
+	const char *names[] = { "stroke", "random" };
+	const std::vector<guint8> *pictures[] = { &stroke, &a };
+	for (int i = 0; i < 2; i++) {
+		gint64 fast = time_unpremultiply(&unpremultiply, *pictures[i], S, S, rounds);
+		gint64 slow = time_unpremultiply(&unpremultiply_scalar, *pictures[i], S, S, rounds);
+		printf("Time (%s %dx%d): %.2f us, %.2f us without the fast path\n",
+				names[i], S, S, (double)fast / rounds, (double)slow / rounds);
+	}
+	g_rand_free(rand);
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
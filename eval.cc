@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+// easystroke-eval: runs a set of labelled strokes through the same matcher
+// the application uses and reports how well and how fast it recognizes them.
+// No X connection is needed.
+#include "actiondb.h"
+#include "main.h"
+#include <glibmm.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+// The parts of the application that actiondb.cc and prefdb.cc refer to.
+// Actions are never run here.
+int verbosity = 0;
+bool experimental = false;
+std::string config_dir;
+const char *prefs_versions[] = { "", nullptr };
+const char *actions_versions[] = { "", nullptr };
+int Atomic::depth = 0;
+std::vector<Base *> Atomic::queue;
+
+bool is_file(std::string filename) { return Glib::file_test(filename, Glib::FILE_TEST_IS_REGULAR); }
+bool is_dir(std::string dirname) { return Glib::file_test(dirname, Glib::FILE_TEST_IS_DIR); }
+void error_dialog(const Glib::ustring &text) { printf("Error: %s\n", text.c_str()); }
+void spawn_command(const std::string &cmd, const std::vector<std::string> &env, const void *owner, int max_running, int debounce) {}
+void Button::run() {}
+void SendKey::run() {}
+void SendText::run() {}
+void Misc::run() {}
+RModifiers ModAction::prepare() { return RModifiers(); }
+RModifiers SendKey::prepare() { return RModifiers(); }
+bool mods_equal(RModifiers m1, RModifiers m2) { return !m1 == !m2; }
+const Glib::ustring SendKey::get_label() const { return "SendKey"; }
+const Glib::ustring ModAction::get_label() const { return "ModAction"; }
+const Glib::ustring Scroll::get_label() const { return "Scroll"; }
+const Glib::ustring Ignore::get_label() const { return "Ignore"; }
+Glib::ustring ButtonInfo::get_button_text() const { return Glib::ustring::compose("Button %1", button); }
+
+// One stroke per line: the expected action name, a tab, trigger, button,
+// modifiers and timeout separated by spaces, a tab and the points as "x,y"
+// separated by spaces.
+struct Sample {
+	std::string label;
+	RStroke stroke;
+	std::string result;
+	gint64 us;
+};
+
+static bool read_samples(const char *filename, std::vector<Sample> &samples) {
+	std::ifstream ifs(filename);
+	if (ifs.fail())
+		return false;
+	std::string line;
+	int n = 0;
+	while (std::getline(ifs, line)) {
+		n++;
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream is(line);
+		Sample sample;
+		std::string info, points;
+		if (!std::getline(is, sample.label, '\t') || !std::getline(is, info, '\t')) {
+			printf("Warning: %s:%d: malformed line\n", filename, n);
+			continue;
+		}
+		std::getline(is, points);
+		int trigger = 0, button = 0, timeout = 0;
+		unsigned int modifiers = 0;
+		std::istringstream(info) >> trigger >> button >> modifiers >> timeout;
+		PreStroke ps;
+		std::istringstream ip(points);
+		double x, y;
+		char comma;
+		for (int t = 0; ip >> x >> comma >> y; t++)
+			ps.add(create_triple(x, y, t));
+		sample.stroke = Stroke::create(ps, trigger, button, modifiers, timeout);
+		sample.us = 0;
+		samples.push_back(sample);
+	}
+	return true;
+}
+
+// Writes the strokes of an action list in the format above, handy as a
+// baseline and as an example
+static bool export_samples(const char *filename, const ActionListDiff *l) {
+	std::ofstream ofs(filename);
+	if (ofs.fail())
+		return false;
+	boost::shared_ptr<std::map<Unique *, StrokeSet> > strokes = l->get_strokes();
+	for (std::map<Unique *, StrokeSet>::const_iterator i = strokes->begin(); i != strokes->end(); i++) {
+		std::string name = l->get_info(i->first)->name;
+		for (StrokeSet::const_iterator j = i->second.begin(); j != i->second.end(); j++) {
+			const Stroke &s = **j;
+			ofs << name << '\t' << s.trigger << ' ' << s.button << ' ' << s.modifiers << ' ' << s.timeout << '\t';
+			for (unsigned int k = 0; k < s.size(); k++) {
+				Stroke::Point p = s.points(k);
+				ofs << (k ? " " : "") << p.x << ',' << p.y;
+			}
+			ofs << '\n';
+		}
+	}
+	ofs.close();
+	return !ofs.fail();
+}
+
+class Evaluation {
+	const ActionListDiff *list;
+	std::vector<Sample> &samples;
+	gint next;
+public:
+	Evaluation(const ActionListDiff *list_, std::vector<Sample> &samples_) : list(list_), samples(samples_), next(0) {}
+	void work() {
+		for (;;) {
+			int i = g_atomic_int_add(&next, 1);
+			if (i >= (int)samples.size())
+				return;
+			Sample &s = samples[i];
+			RRanking r;
+			gint64 start = g_get_monotonic_time();
+			RAction act = list->handle(s.stroke, r);
+			s.us = g_get_monotonic_time() - start;
+			if (IS_CLICK(act))
+				s.result = "(click)";
+			else if (!act)
+				s.result = "(none)";
+			else
+				s.result = r->name;
+		}
+	}
+};
+
+static gint64 percentile(const std::vector<gint64> &v, double p) {
+	return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void report(const std::vector<Sample> &samples, int threads, gint64 elapsed) {
+	int correct = 0;
+	std::map<std::string, std::map<std::string, int> > confusion;
+	std::vector<gint64> latency;
+	for (std::vector<Sample>::const_iterator i = samples.begin(); i != samples.end(); i++) {
+		if (i->result == i->label)
+			correct++;
+		confusion[i->label][i->result]++;
+		latency.push_back(i->us);
+	}
+	std::sort(latency.begin(), latency.end());
+	int n = samples.size();
+	printf("Strokes:      %d\n", n);
+	printf("Threads:      %d\n", threads);
+	printf("Accuracy:     %.2f%% (%d/%d)\n", 100.0 * correct / n, correct, n);
+	printf("Throughput:   %.1f strokes/s\n", elapsed ? 1e6 * n / elapsed : 0.0);
+	printf("Latency (us): min %ld, median %ld, 90%% %ld, 99%% %ld, max %ld\n",
+			(long)latency.front(), (long)percentile(latency, 0.5), (long)percentile(latency, 0.9),
+			(long)percentile(latency, 0.99), (long)latency.back());
+	printf("\nConfusion (expected: recognized count, ...):\n");
+	for (std::map<std::string, std::map<std::string, int> >::iterator i = confusion.begin(); i != confusion.end(); i++) {
+		printf("  %s:", i->first.c_str());
+		for (std::map<std::string, int>::iterator j = i->second.begin(); j != i->second.end(); j++)
+			printf("%s %s %d", j == i->second.begin() ? "" : ",", j->first.c_str(), j->second);
+		printf("\n");
+	}
+}
+
+static void usage(const char *me) {
+	printf("Usage: %s [OPTION]... ACTIONS [STROKES]\n", me);
+	printf("Recognize the labelled strokes in STROKES using the action database ACTIONS.\n");
+	printf("\n");
+	printf("  -a <class>    Use the actions of application <class>\n");
+	printf("  -j <n>        Use <n> threads (default: number of processors)\n");
+	printf("  -e <file>     Write the strokes of ACTIONS to <file> in the STROKES format\n");
+	printf("  -v            Increase verbosity level\n");
+}
+
+int main(int argc, char **argv) {
+	Glib::init();
+	std::string app;
+	const char *export_file = nullptr;
+	int threads = g_get_num_processors();
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			verbosity++;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		if (!strcmp(argv[i], "-a"))
+			app = argv[++i];
+		else if (!strcmp(argv[i], "-j"))
+			threads = std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-e"))
+			export_file = argv[++i];
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (i >= argc || (!export_file && i + 1 >= argc)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!load_actions(argv[i])) {
+		printf("Error: Couldn't read %s\n", argv[i]);
+		return EXIT_FAILURE;
+	}
+	const ActionListDiff *list = actions.get_action_list(app);
+	if (export_file) {
+		if (!export_samples(export_file, list)) {
+			printf("Error: Couldn't write %s\n", export_file);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	std::vector<Sample> samples;
+	if (!read_samples(argv[i+1], samples)) {
+		printf("Error: Couldn't read %s\n", argv[i+1]);
+		return EXIT_FAILURE;
+	}
+	if (samples.empty()) {
+		printf("Error: No strokes in %s\n", argv[i+1]);
+		return EXIT_FAILURE;
+	}
+
+	Evaluation eval(list, samples);
+	gint64 start = g_get_monotonic_time();
+	std::vector<Glib::Threads::Thread *> workers;
+	for (int j = 1; j < threads; j++)
+		workers.push_back(Glib::Threads::Thread::create(sigc::mem_fun(eval, &Evaluation::work)));
+	eval.work();
+	for (std::vector<Glib::Threads::Thread *>::iterator j = workers.begin(); j != workers.end(); j++)
+		(*j)->join();
+	report(samples, threads, g_get_monotonic_time() - start);
+	return EXIT_SUCCESS;
+}
@@ -15,6 +15,7 @@
  */
 #include "gesture.h"
 #include "prefdb.h"
+#include "latency.h"
 
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -70,11 +71,12 @@ template<class Archive> void Stroke::load(Archive & ar, const unsigned int versi
 	ar & modifiers;
 }
 
-Stroke::Stroke(PreStroke &ps, int trigger_, int button_, unsigned int modifiers_, bool timeout_) : trigger(trigger_), button(button_), modifiers(modifiers_), timeout(timeout_) {
+Stroke::Stroke(PreStroke &ps, int trigger_, int button_, unsigned int modifiers_, bool timeout_) : id(0), trigger(trigger_), button(button_), modifiers(modifiers_), timeout(timeout_) {
 	if (ps.valid()) {
 		stroke_t *s = stroke_alloc(ps.size());
 		for (std::vector<RTriple>::iterator i = ps.begin(); i != ps.end(); ++i)
 			stroke_add_point(s, (*i)->x, (*i)->y);
+		LATENCY_SCOPE(LatencyStrokeFinish);
 		stroke_finish(s);
 		stroke.reset(s, &stroke_free);
 	}
@@ -99,7 +101,11 @@ int Stroke::compare(RStroke a, RStroke b, double &score) {
 		}
 		return -1;
 	}
-	double cost = stroke_compare(a->stroke.get(), b->stroke.get(), nullptr, nullptr);
+	double cost;
+	{
+		LATENCY_SCOPE(LatencyCompare);
+		cost = stroke_compare(a->stroke.get(), b->stroke.get(), nullptr, nullptr);
+	}
 	if (cost >= stroke_infinity)
 		return -1;
 	score = MAX(1.0 - 2.5*cost, 0.0);
@@ -109,14 +115,16 @@ int Stroke::compare(RStroke a, RStroke b, double &score) {
 		return score > 0.7;
 }
 
-Glib::RefPtr<Gdk::Pixbuf> Stroke::draw(int size, double width, bool inv) const {
-	if (size != STROKE_SIZE || (width != 2.0 && width != 4.0) || inv)
-		return draw_(size, width, inv);
-	int i = width == 2.0;
-	if (pb[i])
-		return pb[i];
-	pb[i] = draw_(size, width);
-	return pb[i];
+gint Stroke::next_id = 0;
+
+unsigned int Stroke::get_id() const {
+	gint i = g_atomic_int_get(&id);
+	if (i)
+		return i;
+	i = g_atomic_int_add(&next_id, 1) + 1;
+	if (!g_atomic_int_compare_and_exchange(&id, 0, i))
+		i = g_atomic_int_get(&id);
+	return i;
 }
 
 Glib::RefPtr<Gdk::Pixbuf> Stroke::pbEmpty;
@@ -48,6 +48,7 @@ class Stroke {
 	friend class PreStroke;
 	friend class boost::serialization::access;
 	friend class Stats;
+	friend class ThumbnailCache;
 public:
 	struct Point {
 		double x;
@@ -77,7 +78,10 @@ private:
 	Stroke(PreStroke &s, int trigger_, int button_, unsigned int modifiers_, bool timeout_);
 
 	Glib::RefPtr<Gdk::Pixbuf> draw_(int size, double width = 2.0, bool inv = false) const;
-	mutable Glib::RefPtr<Gdk::Pixbuf> pb[2];
+	// Identifies the stroke in the thumbnail cache, assigned on first use.
+	// Strokes are drawn from the matrix and eval threads as well.
+	mutable gint id;
+	static gint next_id;
 
 	static Glib::RefPtr<Gdk::Pixbuf> drawEmpty_(int);
 	static Glib::RefPtr<Gdk::Pixbuf> pbEmpty;
@@ -92,7 +96,9 @@ public:
 	bool timeout;
 	boost::shared_ptr<stroke_t> stroke;
 
-	Stroke() : trigger(0), button(0), modifiers(AnyModifier), timeout(false) {}
+	Stroke() : id(0), trigger(0), button(0), modifiers(AnyModifier), timeout(false) {}
+	// Copies are usually modified, so they don't share the thumbnails
+	Stroke(const Stroke &s) : id(0), trigger(s.trigger), button(s.button), modifiers(s.modifiers), timeout(s.timeout), stroke(s.stroke) {}
 	static RStroke create(PreStroke &s, int trigger_, int button_, unsigned int modifiers_, bool timeout_) {
 		return RStroke(new Stroke(s, trigger_, button_, modifiers_, timeout_));
 	}
@@ -111,6 +117,7 @@ public:
 	Point points(int n) const { Point p; stroke_get_point(stroke.get(), n, &p.x, &p.y); return p; }
 	double time(int n) const { return stroke_get_time(stroke.get(), n); }
 	bool is_timeout() const { return timeout; }
+	unsigned int get_id() const;
 };
 BOOST_CLASS_VERSION(Stroke, 5)
 BOOST_CLASS_VERSION(Stroke::Point, 1)
@@ -121,4 +128,5 @@ public:
 	void add(RTriple p) { push_back(p); }
 	bool valid() const { return size() > 2; }
 };
+
 #endif
@@ -22,6 +22,8 @@
 #include <X11/cursorfont.h>
 #include <X11/Xutil.h>
 #include <glibmm/i18n.h>
+#include <unordered_map>
+#include <unordered_set>
 
 extern Source<bool> disabled;
 extern Source<Window> current_app_window;
@@ -86,8 +88,68 @@ XAtom _NET_WM_STATE("_NET_WM_STATE");
 XAtom _NET_WM_STATE_HIDDEN("_NET_WM_STATE_HIDDEN");
 XAtom _NET_ACTIVE_WINDOW("_NET_ACTIVE_WINDOW");
 
-std::list<Window> minimized;
-unsigned int minimized_n = 0;
+void forget_wm_class(Window w);
+
+// Windows we get a DestroyNotify for: the children of the root window and the
+// client windows we selected StructureNotifyMask on
+static std::unordered_set<Window> watched;
+
+// A list of windows with constant time lookup and removal
+class WindowStack {
+	std::list<Window> order;
+	std::unordered_map<Window, std::list<Window>::iterator> index;
+public:
+	bool empty() const { return order.empty(); }
+	bool contains(Window w) const { return index.count(w); }
+	// Adds w to the top or moves it there
+	void push(Window w) {
+		remove(w);
+		index[w] = order.insert(order.end(), w);
+	}
+	void remove(Window w) {
+		std::unordered_map<Window, std::list<Window>::iterator>::iterator i = index.find(w);
+		if (i == index.end())
+			return;
+		order.erase(i->second);
+		index.erase(i);
+	}
+	Window pop_front() {
+		Window w = order.front();
+		remove(w);
+		return w;
+	}
+	Window pop_back() {
+		Window w = order.back();
+		remove(w);
+		return w;
+	}
+};
+
+// Minimized windows, most recently minimized on top
+static WindowStack minimized;
+// Windows whose _NET_WM_STATE changed since we last looked, in the order of
+// their first change.  A window that is already known to be minimized keeps
+// its place in minimized, so only the transition itself counts.
+static WindowStack wm_state_changed;
+
+static void read_wm_states() {
+	while (!wm_state_changed.empty()) {
+		Window w = wm_state_changed.pop_front();
+		bool is_hidden = xstate->has_atom(w, *_NET_WM_STATE, *_NET_WM_STATE_HIDDEN);
+		if (!is_hidden)
+			minimized.remove(w);
+		else if (!minimized.contains(w))
+			minimized.push(w);
+	}
+}
+
+// The changed windows are read together a moment after the first change, so
+// that a burst of changes costs one read per window, off the event path
+#define WM_STATE_DELAY 100
+
+class WMStateReader : public Timeout {
+	virtual void timeout() { read_wm_states(); }
+} wm_state_reader;
 
 void get_frame(Window w) {
 	Window frame = xstate->get_window(w, *_NET_FRAME_WINDOW);
@@ -117,6 +179,8 @@ bool Children::handle(XEvent &ev) {
 			frame_child.erase1(ev.xdestroywindow.window);
 			frame_child.erase2(ev.xdestroywindow.window);
 			minimized.remove(ev.xdestroywindow.window);
+			wm_state_changed.remove(ev.xdestroywindow.window);
+			forget_wm_class(ev.xdestroywindow.window);
 			destroy(ev.xdestroywindow.window);
 			return true;
 		case ReparentNotify:
@@ -140,14 +204,13 @@ bool Children::handle(XEvent &ev) {
 			if (ev.xproperty.atom == *_NET_WM_STATE) {
 				if (ev.xproperty.state == PropertyDelete) {
 					minimized.remove(ev.xproperty.window);
+					wm_state_changed.remove(ev.xproperty.window);
 					return true;
 				}
-				bool was_hidden = std::find(minimized.begin(), minimized.end(), ev.xproperty.window) != minimized.end();
-				bool is_hidden = xstate->has_atom(ev.xproperty.window, *_NET_WM_STATE, *_NET_WM_STATE_HIDDEN);
-				if (was_hidden && !is_hidden)
-					minimized.remove(ev.xproperty.window);
-				if (is_hidden && !was_hidden)
-					minimized.push_back(ev.xproperty.window);
+				if (wm_state_changed.empty())
+					wm_state_reader.set_timeout(WM_STATE_DELAY);
+				if (!wm_state_changed.contains(ev.xproperty.window))
+					wm_state_changed.push(ev.xproperty.window);
 				return true;
 			}
 			return false;
@@ -161,15 +224,18 @@ void Children::add(Window w) {
 		return;
 
 	XSelectInput(dpy, w, EnterWindowMask | PropertyChangeMask);
+	watched.insert(w);
 	get_frame(w);
 }
 
 void Children::remove(Window w) {
 	XSelectInput(dpy, w, 0);
+	forget_wm_class(w);
 	destroy(w);
 }
 
 void Children::destroy(Window w) {
+	watched.erase(w);
 	frame_win.erase1(w);
 	frame_win.erase2(w);
 }
@@ -188,18 +254,35 @@ static void activate(Window w, Time t) {
 	XSendEvent(dpy, ROOT, False, SubstructureNotifyMask | SubstructureRedirectMask, (XEvent *)&ev);
 }
 
+// Dropped when the window goes away or its WM_CLASS changes, so we make sure
+// to hear about both for every window in here
+static std::unordered_map<Window, std::string> wm_class_cache;
+
 std::string get_wm_class(Window w) {
 	if (!w)
 		return "";
+	std::unordered_map<Window, std::string>::iterator i = wm_class_cache.find(w);
+	if (i != wm_class_cache.end())
+		return i->second;
 	XClassHint ch;
-	if (!XGetClassHint(dpy, w, &ch))
-		return "";
-	std::string ans = ch.res_name;
-	XFree(ch.res_name);
-	XFree(ch.res_class);
+	std::string ans;
+	if (XGetClassHint(dpy, w, &ch)) {
+		ans = ch.res_name;
+		XFree(ch.res_name);
+		XFree(ch.res_class);
+	}
+	if (!watched.count(w)) {
+		XSelectInput(dpy, w, StructureNotifyMask | PropertyChangeMask);
+		watched.insert(w);
+	}
+	wm_class_cache[w] = ans;
 	return ans;
 }
 
+void forget_wm_class(Window w) {
+	wm_class_cache.erase(w);
+}
+
 class IdleNotifier : public Base {
 	sigc::slot<void> f;
 	void run() { f(); }
@@ -209,10 +292,11 @@ public:
 };
 
 void Grabber::unminimize() {
+	wm_state_reader.remove_timeout();
+	read_wm_states();
 	if (minimized.empty())
 		return;
-	Window w = minimized.back();
-	minimized.pop_back();
+	Window w = minimized.pop_back();
 	activate(w, CurrentTime);
 }
 
@@ -224,10 +308,9 @@ Grabber::Grabber() : children(ROOT) {
 	suspend();
 	active = true;
 	grabbed = NONE;
-	xi_grabbed = false;
-	xi_devs_grabbed = GrabNo;
 	grabbed_button.button = 0;
 	grabbed_button.state = 0;
+	update_button_table();
 	cursor_select = XCreateFontCursor(dpy, XC_crosshair);
 	init_xi();
 	prefs.excluded_devices.connect(new IdleNotifier(sigc::mem_fun(*this, &Grabber::update)));
@@ -267,8 +350,6 @@ bool Grabber::init_xi() {
 	XIFreeDeviceInfo(info);
 	prefs.excluded_devices.connect(new IdleNotifier(sigc::mem_fun(*this, &Grabber::update_excluded)));
 	update_excluded();
-	xi_grabbed = false;
-	set();
 
 	if (!xi_devs.size()) {
 		printf("Error: No suitable XInput devices found\n");
@@ -332,10 +413,9 @@ bool Grabber::hierarchy_changed(XIHierarchyEvent *event) {
 }
 
 void Grabber::update_excluded() {
-	suspend();
 	for (DeviceMap::iterator i = xi_devs.begin(); i != xi_devs.end(); ++i)
 		i->second->active = !prefs.excluded_devices.ref().count(i->second->name);
-	resume();
+	set();
 }
 
 bool is_xtest_device(int dev) {
@@ -367,7 +447,7 @@ void Grabber::new_device(XIDeviceInfo *info) {
 		}
 }
 
-Grabber::XiDevice::XiDevice(Grabber *parent, XIDeviceInfo *info) : absolute(false), active(true), proximity_axis(-1), scale_x(1.0), scale_y(1.0), num_buttons(0) {
+Grabber::XiDevice::XiDevice(Grabber *parent, XIDeviceInfo *info) : absolute(false), active(true), proximity_axis(-1), scale_x(1.0), scale_y(1.0), num_buttons(0), grabbed(GrabNo) {
 	static XAtom PROXIMITY(AXIS_LABEL_PROP_ABS_DISTANCE);
 	dev = info->deviceid;
 	name = info->name;
@@ -401,7 +481,7 @@ Grabber::XiDevice *Grabber::get_xi_dev(int id) {
 	return i == xi_devs.end() ? nullptr : i->second.get();
 }
 
-void Grabber::XiDevice::grab_button(ButtonInfo &bi, bool grab) {
+void Grabber::XiDevice::grab_button(const ButtonInfo &bi, bool grab) {
 	XIGrabModifiers modifiers[4] = {{0,0},{0,0},{0,0},{0,0}};
 	int nmods = 0;
 	if (bi.button == AnyModifier) {
@@ -420,16 +500,6 @@ void Grabber::XiDevice::grab_button(ButtonInfo &bi, bool grab) {
 	}
 }
 
-void Grabber::grab_xi(bool grab) {
-	if (!xi_grabbed == !grab)
-		return;
-	xi_grabbed = grab;
-	for (DeviceMap::iterator i = xi_devs.begin(); i != xi_devs.end(); ++i)
-		if (i->second->active)
-			for (std::vector<ButtonInfo>::iterator j = buttons.begin(); j != buttons.end(); j++)
-				i->second->grab_button(*j, grab);
-}
-
 void Grabber::XiDevice::grab_device(GrabState grab) {
 	if (grab == GrabNo) {
 		XIUngrabDevice(dpy, dev, CurrentTime);
@@ -440,25 +510,47 @@ void Grabber::XiDevice::grab_device(GrabState grab) {
 			grab == GrabYes ? &device_mask : &raw_mask);
 }
 
-void Grabber::grab_xi_devs(GrabState grab) {
-	if (xi_devs_grabbed == grab)
-		return;
-	xi_devs_grabbed = grab;
-	for (DeviceMap::iterator i = xi_devs.begin(); i != xi_devs.end(); ++i)
-		i->second->grab_device(grab);
+// Only send the requests needed to get from the grabs in effect to the
+// wanted ones
+bool Grabber::XiDevice::apply(const std::vector<ButtonInfo> &want_buttons, GrabState want) {
+	bool changed = false;
+	for (std::vector<ButtonInfo>::const_iterator i = grabbed_buttons.begin(); i != grabbed_buttons.end(); ++i)
+		if (std::find(want_buttons.begin(), want_buttons.end(), *i) == want_buttons.end()) {
+			grab_button(*i, false);
+			changed = true;
+		}
+	for (std::vector<ButtonInfo>::const_iterator i = want_buttons.begin(); i != want_buttons.end(); ++i)
+		if (std::find(grabbed_buttons.begin(), grabbed_buttons.end(), *i) == grabbed_buttons.end()) {
+			grab_button(*i, true);
+			changed = true;
+		}
+	if (changed)
+		grabbed_buttons = want_buttons;
+	if (grabbed != want) {
+		grab_device(want);
+		grabbed = want;
+		changed = true;
+	}
+	return changed;
 }
 
 void Grabber::set() {
+	static const std::vector<ButtonInfo> no_buttons;
 	bool act = !suspended && ((active && !disabled.get()) || (current != NONE && current != BUTTON));
-	grab_xi(act && current != SELECT);
-	if (!act)
-		grab_xi_devs(GrabNo);
-	else if (current == NONE)
-		grab_xi_devs(GrabYes);
-	else if (current == RAW)
-		grab_xi_devs(GrabRaw);
-	else
-		grab_xi_devs(GrabNo);
+	bool grab_buttons = act && current != SELECT;
+	GrabState grab_devs = GrabNo;
+	if (act && current == NONE)
+		grab_devs = GrabYes;
+	else if (act && current == RAW)
+		grab_devs = GrabRaw;
+	bool changed = false;
+	for (DeviceMap::iterator i = xi_devs.begin(); i != xi_devs.end(); ++i) {
+		XiDevice *dev = i->second.get();
+		if (dev->apply(grab_buttons && dev->active ? buttons : no_buttons, grab_devs))
+			changed = true;
+	}
+	if (changed)
+		XFlush(dpy);
 	State old = grabbed;
 	grabbed = act ? current : NONE;
 	if (old == grabbed)
@@ -489,32 +581,22 @@ std::string Grabber::select_window() {
 	return xstate->select_window();
 }
 
-bool Grabber::is_grabbed(guint b) {
-	for (std::vector<ButtonInfo>::iterator i = buttons.begin(); i != buttons.end(); i++)
-		if (i->button == b)
-			return true;
-	return false;
-}
-
-bool Grabber::is_instant(guint b) {
-	for (std::vector<ButtonInfo>::iterator i = buttons.begin(); i != buttons.end(); i++)
-		if (i->button == b && i->instant)
-			return true;
-	return false;
-}
-
-bool Grabber::is_click_hold(guint b) {
-	for (std::vector<ButtonInfo>::iterator i = buttons.begin(); i != buttons.end(); i++)
-		if (i->button == b && i->click_hold)
-			return true;
-	return false;
-}
-
-guint Grabber::get_default_mods(guint button) {
-	for (std::vector<ButtonInfo>::const_iterator i = buttons.begin(); i != buttons.end(); ++i)
-		if (i->button == button)
-			return i->state;
-	return AnyModifier;
+void Grabber::update_button_table() {
+	memset(button_flags, 0, sizeof(button_flags));
+	for (int b = 0; b < MAX_BUTTONS; b++)
+		button_mods[b] = AnyModifier;
+	for (std::vector<ButtonInfo>::const_iterator i = buttons.begin(); i != buttons.end(); ++i) {
+		if (i->button >= MAX_BUTTONS)
+			continue;
+		// The first entry for a button determines its modifiers
+		if (!(button_flags[i->button] & BUTTON_GRABBED))
+			button_mods[i->button] = i->state;
+		button_flags[i->button] |= BUTTON_GRABBED;
+		if (i->instant)
+			button_flags[i->button] |= BUTTON_INSTANT;
+		if (i->click_hold)
+			button_flags[i->button] |= BUTTON_CLICK_HOLD;
+	}
 }
 
 void Grabber::update() {
@@ -538,7 +620,6 @@ void Grabber::update() {
 		set();
 		return;
 	}
-	suspend();
 	grabbed_button = bi;
 	buttons.clear();
 	buttons.reserve(extra.size() + 1);
@@ -546,7 +627,8 @@ void Grabber::update() {
 	for (std::vector<ButtonInfo>::const_iterator i = extra.begin(); i != extra.end(); ++i)
 		if (!i->overlap(bi))
 			buttons.push_back(*i);
-	resume();
+	update_button_table();
+	set();
 }
 
 // Fuck Xlib
@@ -605,6 +687,7 @@ Window get_app_window(Window w) {
 		if (w2 != w) {
 			w = w2;
 			XSelectInput(dpy, w2, StructureNotifyMask | PropertyChangeMask);
+			watched.insert(w2);
 		}
 		return w2;
 	}
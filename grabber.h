@@ -66,9 +66,13 @@ public:
 		double scale_x, scale_y;
 		int num_buttons;
 		int master;
+		// The grabs currently in effect on the server
+		GrabState grabbed;
+		std::vector<ButtonInfo> grabbed_buttons;
 		XiDevice(Grabber *, XIDeviceInfo *);
 		void grab_device(GrabState grab);
-		void grab_button(ButtonInfo &bi, bool grab);
+		void grab_button(const ButtonInfo &bi, bool grab);
+		bool apply(const std::vector<ButtonInfo> &want_buttons, GrabState want);
 	};
 
 	typedef std::map<XID, boost::shared_ptr<XiDevice> > DeviceMap;
@@ -79,17 +83,20 @@ private:
 
 	DeviceMap xi_devs;
 	State current, grabbed;
-	bool xi_grabbed;
-	GrabState xi_devs_grabbed;
 	int suspended;
 	bool active;
 	Cursor cursor_select;
 	ButtonInfo grabbed_button;
 	std::vector<ButtonInfo> buttons;
 
+	// Per-button summary of buttons, so that the predicates below don't
+	// have to search it
+	enum { BUTTON_GRABBED = 1, BUTTON_INSTANT = 2, BUTTON_CLICK_HOLD = 4 };
+	unsigned char button_flags[MAX_BUTTONS];
+	guint button_mods[MAX_BUTTONS];
+	void update_button_table();
+
 	void set();
-	void grab_xi(bool);
-	void grab_xi_devs(GrabState);
 
 	void update_excluded();
 
@@ -109,13 +116,13 @@ public:
 
 	void new_device(XIDeviceInfo *);
 
-	bool is_grabbed(guint b);
-	bool is_instant(guint b);
-	bool is_click_hold(guint b);
+	bool is_grabbed(guint b) { return b < MAX_BUTTONS && (button_flags[b] & BUTTON_GRABBED); }
+	bool is_instant(guint b) { return b < MAX_BUTTONS && (button_flags[b] & BUTTON_INSTANT); }
+	bool is_click_hold(guint b) { return b < MAX_BUTTONS && (button_flags[b] & BUTTON_CLICK_HOLD); }
 	bool hierarchy_changed(XIHierarchyEvent *);
 
 	int get_default_button() { return grabbed_button.button; }
-	guint get_default_mods(guint button);
+	guint get_default_mods(guint b) { return b < MAX_BUTTONS ? button_mods[b] : AnyModifier; }
 
 	void unminimize();
 };
@@ -18,15 +18,19 @@
 #include "trace.h"
 #include "win.h" // Why?
 #include "prefs.h" // Why?
+#include "keymap.h"
+#include "latency.h"
 #include <gtkmm.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XTest.h>
 #include <X11/XKBlib.h>
 #include <X11/Xproto.h>
+#include <deque>
 
 XState *xstate = nullptr;
 
 extern Window get_app_window(Window w);
+extern void forget_wm_class(Window w);
 extern Source<Window> current_app_window;
 extern boost::shared_ptr<Trace> trace;
 
@@ -47,17 +51,33 @@ void XState::queue(sigc::slot<void> f) {
 		queued.push_back(f);
 }
 
+// Only the window the pointer comes to rest in is looked up, so that
+// sweeping across the screen doesn't cause any traffic
+#define ENTER_DELAY 50
+
+class EnterDelay : public Timeout {
+	Window w;
+	virtual void timeout() {
+		current_app_window.set(get_app_window(w));
+		if (verbosity >= 3)
+			printf("Entered window 0x%lx -> 0x%lx\n", w, current_app_window.get());
+	}
+public:
+	void enter(Window w_) {
+		w = w_;
+		set_timeout(ENTER_DELAY);
+	}
+} enter_delay;
+
 void XState::handle_enter_leave(XEvent &ev) {
 	if (ev.xcrossing.mode == NotifyGrab)
 		return;
 	if (ev.xcrossing.detail == NotifyInferior)
 		return;
 	Window w = ev.xcrossing.window;
-	if (ev.type == EnterNotify) {
-		current_app_window.set(get_app_window(w));
-		if (verbosity >= 3)
-			printf("Entered window 0x%lx -> 0x%lx\n", w, current_app_window.get());
-	} else printf("Error: Bogus Enter/Leave event\n");
+	if (ev.type == EnterNotify)
+		enter_delay.enter(w);
+	else printf("Error: Bogus Enter/Leave event\n");
 }
 
 #define H (handler->top())
@@ -70,8 +90,11 @@ void XState::handle_event(XEvent &ev) {
 		return;
 
 	case PropertyNotify:
-		if (current_app_window.get() == ev.xproperty.window && ev.xproperty.atom == XA_WM_CLASS)
-			current_app_window.notify();
+		if (ev.xproperty.atom == XA_WM_CLASS) {
+			forget_wm_class(ev.xproperty.window);
+			if (current_app_window.get() == ev.xproperty.window)
+				current_app_window.notify();
+		}
 		return;
 
 	case ButtonPress:
@@ -93,8 +116,10 @@ void XState::handle_event(XEvent &ev) {
 	case MappingNotify:
 		if (ev.xmapping.request == MappingPointer)
 			update_core_mapping();
-		if (ev.xmapping.request == MappingKeyboard || ev.xmapping.request == MappingModifier)
+		if (ev.xmapping.request == MappingKeyboard || ev.xmapping.request == MappingModifier) {
 			XRefreshKeyboardMapping(&ev.xmapping);
+			keymap.invalidate();
+		}
 		return;
 	case GenericEvent:
 		if (ev.xcookie.extension == grabber->opcode && XGetEventData(dpy, &ev.xcookie)) {
@@ -252,6 +277,7 @@ void XState::handle_xi2_event(XIDeviceEvent *event) {
 				if (!current_dev || current_dev->dev != event->deviceid)
 					break;
 			} else {
+				enter_delay.remove_timeout();
 				current_app_window.set(get_app_window(event->child));
 				if (verbosity >= 3)
 					printf("Active window 0x%lx -> 0x%lx\n", event->child, current_app_window.get());
@@ -288,10 +314,12 @@ void XState::handle_xi2_event(XIDeviceEvent *event) {
 				report_xi2_event(event, "Motion");
 			if (!current_dev || current_dev->dev != event->deviceid)
 				break;
+			// Every point counts while a stroke is being recorded, so
+			// pointer motion is passed on right away
+			flush_motion();
 			H->motion(create_triple(event->root_x, event->root_y, event->time));
 			break;
 		case XI_RawMotion:
-			in_proximity = get_axis(((XIRawEvent *)event)->valuators, current_dev->proximity_axis);
 			handle_raw_motion((XIRawEvent *)event);
 			break;
 		case XI_HierarchyChanged:
@@ -303,20 +331,6 @@ void XState::handle_xi2_event(XIDeviceEvent *event) {
 void XState::handle_raw_motion(XIRawEvent *event) {
 	if (!current_dev || current_dev->dev != event->deviceid)
 		return;
-	double x = 0.0, y = 0.0;
-	bool abs_x = current_dev->absolute;
-	bool abs_y = current_dev->absolute;
-	int i = 0;
-
-	if (XIMaskIsSet(event->valuators.mask, 0))
-		x = event->raw_values[i++];
-	else
-		abs_x = false;
-
-	if (XIMaskIsSet(event->valuators.mask, 1))
-		y = event->raw_values[i++];
-	else
-		abs_y = false;
 
 	if (verbosity >= 5) {
 		printf("Raw motion (XI2): (");
@@ -324,23 +338,73 @@ void XState::handle_raw_motion(XIRawEvent *event) {
 		printf(") at t = %ld\n", event->time);
 	}
 
-	H->raw_motion(create_triple(x * current_dev->scale_x, y * current_dev->scale_y, event->time), abs_x, abs_y);
+	if (motion.type != XI_RawMotion) {
+		flush_motion();
+		motion.type = XI_RawMotion;
+		motion.x = 0.0;
+		motion.y = 0.0;
+		motion.has_x = false;
+		motion.has_y = false;
+	}
+
+	// Relative deltas add up, absolute positions are simply replaced
+	int i = 0;
+	if (XIMaskIsSet(event->valuators.mask, 0)) {
+		float x = event->raw_values[i++] * current_dev->scale_x;
+		motion.x = current_dev->absolute ? x : motion.x + x;
+		motion.has_x = true;
+	}
+	if (XIMaskIsSet(event->valuators.mask, 1)) {
+		float y = event->raw_values[i++] * current_dev->scale_y;
+		motion.y = current_dev->absolute ? y : motion.y + y;
+		motion.has_y = true;
+	}
+	motion.proximity = get_axis(event->valuators, current_dev->proximity_axis);
+	motion.t = event->time;
+}
+
+void XState::flush_motion() {
+	int type = motion.type;
+	motion.type = 0;
+	if (!type || !current_dev)
+		return;
+	in_proximity = motion.proximity;
+	bool abs_x = current_dev->absolute && motion.has_x;
+	bool abs_y = current_dev->absolute && motion.has_y;
+	H->raw_motion(create_triple(motion.x, motion.y, motion.t), abs_x, abs_y);
 }
 
 #undef H
 
+static bool is_motion(XEvent &ev) {
+	return ev.type == GenericEvent && ev.xcookie.extension == grabber->opcode &&
+		(ev.xcookie.evtype == XI_Motion || ev.xcookie.evtype == XI_RawMotion);
+}
+
 bool XState::handle(Glib::IOCondition) {
 	while (XPending(dpy)) {
+		LATENCY_SCOPE(LatencyDispatch);
 		try {
 			XEvent ev;
 			XNextEvent(dpy, &ev);
+			LATENCY_EVENT(LatencyXEvent, ev.type);
+			if (!is_motion(ev)) {
+				flush_motion();
+				flush_scroll();
+			}
 			if (!grabber->handle(ev))
 				handle_event(ev);
+			if (!XEventsQueued(dpy, QueuedAfterReading)) {
+				flush_motion();
+				flush_scroll();
+			}
 		} catch (GrabFailedException &e) {
 			printf(_("Error: %s\n"), e.what());
 			bail_out();
 		}
 	}
+	LATENCY_SCOPE(LatencyFlush);
+	XFlush(dpy);
 	return true;
 }
 
@@ -366,6 +430,31 @@ void XState::fake_click(guint b) {
 	fake_core_button(b, false);
 }
 
+void XState::queue_scroll(guint b, int n) {
+	switch (b) {
+		case 4: scroll_y -= n; break;
+		case 5: scroll_y += n; break;
+		case 6: scroll_x -= n; break;
+		case 7: scroll_x += n; break;
+	}
+}
+
+// The clicks go out without a round trip each, XState::handle flushes the
+// whole batch once the event queue is empty
+void XState::flush_scroll() {
+	if (!scroll_x && !scroll_y)
+		return;
+	if (verbosity >= 4)
+		printf("Scroll: %d, %d\n", scroll_x, scroll_y);
+	guint b = scroll_x > 0 ? 7 : 6;
+	for (int i = 0; i < (scroll_x > 0 ? scroll_x : -scroll_x); i++)
+		fake_click(b);
+	b = scroll_y > 0 ? 5 : 4;
+	for (int i = 0; i < (scroll_y > 0 ? scroll_y : -scroll_y); i++)
+		fake_click(b);
+	scroll_x = scroll_y = 0;
+}
+
 void Handler::replace_child(Handler *c) {
 	if (child)
 		delete child;
@@ -460,6 +549,8 @@ public:
 };
 
 void XState::bail_out() {
+	motion.type = 0;
+	scroll_x = scroll_y = 0;
 	handler->replace_child(nullptr);
 	xinput_pressed.clear();
 	XFlush(dpy);
@@ -496,8 +587,10 @@ int XState::xErrorHandler(Display *dpy2, XErrorEvent *e) {
 int XState::xIOErrorHandler(Display *dpy2) {
 	if (dpy != dpy2)
 		return xstate->oldIOHandler(dpy2);
+	// Xlib exits when the handler returns, so all we can do is save our
+	// state; the X connection must not be used any more
 	printf("Fatal Error: Connection to X server lost\n");
-	quit();
+	save_config();
 	return 0;
 }
 
@@ -535,6 +628,57 @@ public:
 
 static inline float abs(float x) { return x > 0 ? x : -x; }
 
+// Scroll acceleration v -> v*|v|^(1/3), scaled by direction and speed.  The
+// curve is tabulated for speeds up to MAX px/ms and linearly interpolated;
+// faster motion falls back to computing it directly.
+class ScrollCurve {
+	static const int N = 512;
+	static constexpr float MAX = 16.0;
+	float lut[N+1];
+	float factor;
+	static float accel(float v) { return v * cbrtf(v); }
+public:
+	ScrollCurve(float factor_) : factor(factor_) {
+		for (int i = 0; i <= N; i++)
+			lut[i] = factor * accel(i * (MAX / N));
+	}
+	float operator()(float v) const {
+		float a = abs(v) * (N / MAX);
+		float y;
+		if (a >= N) {
+			y = factor * accel(abs(v));
+		} else {
+			int i = (int)a;
+			y = lut[i] + (a - i) * (lut[i+1] - lut[i]);
+		}
+		return v < 0 ? -y : y;
+	}
+};
+
+typedef boost::shared_ptr<ScrollCurve> RScrollCurve;
+
+// One curve per device name, thrown away whenever the scroll prefs change
+static std::map<std::string, RScrollCurve> scroll_curves;
+
+static void invalidate_scroll_curves() {
+	scroll_curves.clear();
+}
+
+static RScrollCurve get_scroll_curve(Grabber::XiDevice *dev) {
+	std::string name = dev ? dev->name : "";
+	std::map<std::string, RScrollCurve>::iterator i = scroll_curves.find(name);
+	if (i != scroll_curves.end())
+		return i->second;
+	double speed = prefs.scroll_speed.get();
+	const std::map<std::string, double> &ds = prefs.device_scroll_speed.ref();
+	std::map<std::string, double>::const_iterator j = ds.find(name);
+	if (j != ds.end())
+		speed = j->second;
+	RScrollCurve curve(new ScrollCurve((prefs.scroll_invert.get() ? 1.0 : -1.0) * speed));
+	scroll_curves[name] = curve;
+	return curve;
+}
+
 class AbstractScrollHandler : public Handler {
 	bool have_x, have_y;
 	float last_x, last_y;
@@ -542,9 +686,11 @@ class AbstractScrollHandler : public Handler {
 	float offset_x, offset_y;
 	Glib::ustring str;
 	int orig_x, orig_y;
+	RScrollCurve curve;
 
 protected:
-	AbstractScrollHandler() : have_x(false), have_y(false), last_x(0.0), last_y(0.0), last_t(0), offset_x(0.0), offset_y(0.0) {
+	AbstractScrollHandler() : have_x(false), have_y(false), last_x(0.0), last_y(0.0), last_t(0), offset_x(0.0), offset_y(0.0),
+			curve(get_scroll_curve(xstate->current_dev)) {
 		if (!prefs.move_back.get() || (xstate->current_dev && xstate->current_dev->absolute))
 			return;
 		Window dummy1, dummy2;
@@ -553,16 +699,14 @@ protected:
 		XQueryPointer(dpy, ROOT, &dummy1, &dummy2, &orig_x, &orig_y, &dummy3, &dummy4, &dummy5);
 	}
 	virtual void fake_wheel(int b1, int n1, int b2, int n2) {
-		for (int i = 0; i<n1; i++)
-			xstate->fake_click(b1);
-		for (int i = 0; i<n2; i++)
-			xstate->fake_click(b2);
-	}
-	static float curve(float v) {
-		return v * exp(log(abs(v))/3);
+		if (n1)
+			xstate->queue_scroll(b1, n1);
+		if (n2)
+			xstate->queue_scroll(b2, n2);
 	}
 protected:
 	void move_back() {
+		xstate->flush_scroll();
 		if (!prefs.move_back.get() || (xstate->current_dev && xstate->current_dev->absolute))
 			return;
 		XTestFakeMotionEvent(dpy, DefaultScreen(dpy), orig_x, orig_y, 0);
@@ -593,9 +737,8 @@ public:
 		int dt = e->t - last_t;
 		last_t = e->t;
 
-		double factor = (prefs.scroll_invert.get() ? 1.0 : -1.0) * prefs.scroll_speed.get();
-		offset_x += factor * curve(dx/dt)*dt/20.0;
-		offset_y += factor * curve(dy/dt)*dt/10.0;
+		offset_x += (*curve)(dx/dt)*dt/20.0;
+		offset_y += (*curve)(dy/dt)*dt/10.0;
 		int b1 = 0, n1 = 0, b2 = 0, n2 = 0;
 		if (abs(offset_x) > 1.0) {
 			n1 = (int)floor(abs(offset_x));
@@ -697,31 +840,66 @@ public:
 	virtual Grabber::State grab_mode() { return Grabber::NONE; }
 };
 
+#define REPLAY_MIN_DIST 4
+
 class AdvancedHandler : public Handler {
 	RTriple e;
 	guint remap_from, remap_to;
 	Time click_time;
 	guint replay_button;
 	RTriple replay_orig;
-	std::map<guint, RAction> as;
-	std::map<guint, RRanking> rs;
+	// The stroke is only matched against the strokes for a button once that
+	// button is actually pressed (or released)
+	struct Result {
+		bool found;
+		RAction action;
+		RRanking ranking;
+	};
+	RStroke stroke;
+	std::string wm_class;
+	std::map<guint, Result> results;
 	std::map<guint, RModifiers> mods;
 	RModifiers sticky_mods;
 	guint button1, button2;
 	RPreStroke replay;
 
+	Result &lookup(guint b) {
+		std::map<guint, Result>::iterator i = results.find(b);
+		if (i != results.end())
+			return i->second;
+		Result &r = results[b];
+		r.found = stroke && actions.get_action_list(wm_class)->handle_advanced(stroke, b, r.action, r.ranking, button1, button2);
+		return r;
+	}
 	void show_ranking(guint b, RTriple e) {
-		if (!rs.count(b))
+		Result &r = lookup(b);
+		if (!r.ranking)
 			return;
-		Ranking::queue_show(rs[b], e);
-		rs.erase(b);
+		Ranking::queue_show(r.ranking, e);
+		r.ranking.reset();
+	}
+	// Replays the buffered motion in one go, leaving out points that are
+	// too close to the previous one to matter (or all but the last one if
+	// the user doesn't want the path replayed).
+	void replay_path() {
+		bool all = prefs.replay_path.get();
+		RTriple sent;
+		for (PreStroke::iterator i = replay->begin(); i != replay->end(); i++) {
+			RTriple p = *i;
+			if (replay_button && hypot(replay_orig->x - p->x, replay_orig->y - p->y) > 16)
+				replay_button = 0;
+			if (i + 1 != replay->end() && (!all || (sent && hypot(p->x - sent->x, p->y - sent->y) < REPLAY_MIN_DIST)))
+				continue;
+			if (xstate->current_dev->master)
+				XTestFakeMotionEvent(dpy, DefaultScreen(dpy), p->x, p->y, 0);
+			sent = p;
+		}
+		XFlush(dpy);
 	}
 	AdvancedHandler(RStroke s, RTriple e_, guint b1, guint b2, RPreStroke replay_) :
 		e(e_), remap_from(0), remap_to(0), click_time(0), replay_button(0),
-		button1(b1), button2(b2), replay(replay_) {
-			if (s)
-				actions.get_action_list(grabber->current_class->get())->handle_advanced(s, as, rs, b1, b2);
-		}
+		stroke(s), wm_class(grabber->current_class->get()),
+		button1(b1), button2(b2), replay(replay_) {}
 public:
 	static Handler *create(RStroke s, RTriple e, guint b1, guint b2, RPreStroke replay) {
 		if (stroke_action && s)
@@ -732,12 +910,10 @@ public:
 	}
 	virtual void init() {
 		if (replay && replay->size()) {
-			bool replay_first = !as.count(button2);
-			PreStroke::iterator i = replay->begin();
+			bool replay_first = !lookup(button2).found;
 			if (replay_first)
-				press(button2 ? button2 : button1, *i);
-			while (i != replay->end())
-				motion(*i++);
+				press(button2 ? button2 : button1, replay->front());
+			replay_path();
 			if (!replay_first)
 				press(button2 ? button2 : button1, e);
 		} else {
@@ -757,13 +933,13 @@ public:
 		replay_button = 0;
 		guint bb = (b == button1) ? button2 : b;
 		show_ranking(bb, e);
-		if (!as.count(bb)) {
+		if (!lookup(bb).found) {
 			sticky_mods.reset();
 			if (xstate->current_dev->master)
 				XTestFakeButtonEvent(dpy, b, true, CurrentTime);
 			return;
 		}
-		RAction act = as[bb];
+		RAction act = lookup(bb).action;
 		if (IS_SCROLL(act)) {
 			click_time = e->t;
 			replay_button = b;
@@ -810,7 +986,7 @@ public:
 			xstate->fake_core_button(remap_to, false);
 		}
 		guint bb = (b == button1) ? button2 : b;
-		if (!as.count(bb)) {
+		if (!lookup(bb).found) {
 			sticky_mods.reset();
 			if (xstate->current_dev->master)
 				XTestFakeButtonEvent(dpy, b, false, CurrentTime);
@@ -872,17 +1048,20 @@ class StrokeHandler : public Handler, public sigc::trackable {
 	RTriple last, orig;
 	bool use_timeout;
 	int init_timeout, final_timeout, radius;
-	struct Connection {
-		sigc::connection c;
+	// The stroke times out once the pointer has moved less than radius
+	// pixels within final_timeout ms.  Every motion event starts such a
+	// window; we remember when it started and how far the pointer had
+	// travelled in total by then.  Windows in which the pointer has already
+	// moved too far are dropped from the front, so the front sample always
+	// determines the next deadline.
+	struct Sample {
+		gint64 t;
 		double dist;
-		Connection(StrokeHandler *parent, double dist_, int to) : dist(dist_) {
-			c = Glib::signal_timeout().connect(sigc::mem_fun(*parent, &StrokeHandler::timeout), to);
-		}
-		~Connection() { c.disconnect(); }
 	};
-	typedef boost::shared_ptr<Connection> RConnection;
+	std::deque<Sample> samples;
+	double travelled;
 	sigc::connection init_connection;
-	std::vector<RConnection> connections;
+	sigc::connection final_connection;
 
 	RStroke finish(guint b) {
 		trace->end();
@@ -914,9 +1093,19 @@ class StrokeHandler : public Handler, public sigc::trackable {
 		parent->replace_child(AdvancedHandler::create(s, orig, button, button, cur));
 	}
 
-	bool expired(RConnection c, double dist) {
-		c->dist -= dist;
-		return c->dist < 0;
+	// Deadlines only ever move forward, so the timer is never rescheduled on
+	// motion.  When it fires early we just set it again for the remainder.
+	bool final_expired() {
+		gint64 left = samples.front().t + (gint64)final_timeout*1000 - g_get_monotonic_time();
+		if (left <= 0)
+			return timeout();
+		schedule_final(left);
+		return false;
+	}
+
+	void schedule_final(gint64 left) {
+		final_connection = Glib::signal_timeout().connect(
+				sigc::mem_fun(*this, &StrokeHandler::final_expired), (left + 999) / 1000);
 	}
 protected:
 	void abort_stroke() {
@@ -952,10 +1141,13 @@ protected:
 			trace->draw(p);
 		}
 		if (use_timeout && is_gesture) {
-			connections.erase(remove_if(connections.begin(), connections.end(),
-						sigc::bind(sigc::mem_fun(*this, &StrokeHandler::expired),
-							hypot(e->x - last->x, e->y - last->y))), connections.end());
-			connections.push_back(RConnection(new Connection(this, radius, final_timeout)));
+			travelled += hypot(e->x - last->x, e->y - last->y);
+			while (!samples.empty() && travelled - samples.front().dist > radius)
+				samples.pop_front();
+			Sample sample = { g_get_monotonic_time(), travelled };
+			samples.push_back(sample);
+			if (!final_connection.connected())
+				schedule_final((gint64)final_timeout*1000);
 		}
 		last = e;
 	}
@@ -985,7 +1177,11 @@ protected:
 			XkbBell(dpy, None, 0, None);
 			return parent->replace_child(nullptr);
 		}
-		RModifiers mods = act->prepare();
+		RModifiers mods;
+		{
+			LATENCY_SCOPE(LatencyPrepare);
+			mods = act->prepare();
+		}
 		if (IS_CLICK(act))
 			act = Button::create((Gdk::ModifierType)0, b);
 		else IF_BUTTON(act, b)
@@ -994,20 +1190,17 @@ protected:
 			return parent->replace_child(new IgnoreHandler(mods));
 		if (IS_SCROLL(act))
 			return parent->replace_child(new ScrollHandler(mods));
-		char buf[16];
-		snprintf(buf, sizeof(buf), "%d", (int)orig->x);
-		setenv("EASYSTROKE_X1", buf, 1);
-		snprintf(buf, sizeof(buf), "%d", (int)orig->y);
-		setenv("EASYSTROKE_Y1", buf, 1);
-		snprintf(buf, sizeof(buf), "%d", (int)e->x);
-		setenv("EASYSTROKE_X2", buf, 1);
-		snprintf(buf, sizeof(buf), "%d", (int)e->y);
-		setenv("EASYSTROKE_Y2", buf, 1);
-		act->run();
-		unsetenv("EASYSTROKE_X1");
-		unsetenv("EASYSTROKE_Y1");
-		unsetenv("EASYSTROKE_X2");
-		unsetenv("EASYSTROKE_Y2");
+		LATENCY_SCOPE(LatencyRun);
+		Command *cmd = dynamic_cast<Command *>(act.get());
+		if (cmd) {
+			std::vector<std::string> env;
+			env.push_back(Glib::ustring::compose("EASYSTROKE_X1=%1", (int)orig->x));
+			env.push_back(Glib::ustring::compose("EASYSTROKE_Y1=%1", (int)orig->y));
+			env.push_back(Glib::ustring::compose("EASYSTROKE_X2=%1", (int)e->x));
+			env.push_back(Glib::ustring::compose("EASYSTROKE_Y2=%1", (int)e->y));
+			cmd->run(env);
+		} else
+			act->run();
 		parent->replace_child(nullptr);
 	}
 public:
@@ -1018,6 +1211,7 @@ public:
 		drawing(false),
 		last(e),
 		orig(e),
+		travelled(0.0),
 		init_timeout(prefs.init_timeout.get()),
 		final_timeout(prefs.final_timeout.get()),
 		radius(16)
@@ -1049,7 +1243,11 @@ public:
 		init_connection = Glib::signal_timeout().connect(
 				sigc::mem_fun(*this, &StrokeHandler::timeout), init_timeout);
 	}
-	~StrokeHandler() { trace->end(); }
+	~StrokeHandler() {
+		init_connection.disconnect();
+		final_connection.disconnect();
+		trace->end();
+	}
 	virtual std::string name() { return "Stroke"; }
 	virtual Grabber::State grab_mode() { return Grabber::NONE; }
 };
@@ -1098,7 +1296,12 @@ std::string XState::select_window() {
 	return grabber->current_class->get();
 }
 
-XState::XState() : current_dev(nullptr), in_proximity(false), accepted(true), modifiers(0) {
+XState::XState() : current_dev(nullptr), in_proximity(false), accepted(true), modifiers(0), scroll_x(0), scroll_y(0) {
+	motion.type = 0;
+	Notifier *scroll_notify = new Notifier(sigc::ptr_fun(&invalidate_scroll_curves));
+	prefs.scroll_invert.connect(scroll_notify);
+	prefs.scroll_speed.connect(scroll_notify);
+	prefs.device_scroll_speed.connect(scroll_notify);
 	int n, opcode, event, error;
 	char **ext = XListExtensions(dpy, &n);
 	for (int i = 0; i < n; i++)
@@ -1113,12 +1316,17 @@ XState::XState() : current_dev(nullptr), in_proximity(false), accepted(true), mo
 }
 
 void XState::run_action(RAction act) {
-	RModifiers mods = act->prepare();
+	RModifiers mods;
+	{
+		LATENCY_SCOPE(LatencyPrepare);
+		mods = act->prepare();
+	}
 	IF_BUTTON(act, b)
 		return handler->replace_child(new ButtonHandler(mods, b));
 	if (IS_IGNORE(act))
 		return handler->replace_child(new IgnoreHandler(mods));
 	if (IS_SCROLL(act))
 		return handler->replace_child(new ScrollHandler(mods));
+	LATENCY_SCOPE(LatencyRun);
 	act->run();
 }
@@ -31,10 +31,13 @@ public:
 	void handle_event(XEvent &ev);
 	void handle_xi2_event(XIDeviceEvent *event);
 	void handle_raw_motion(XIRawEvent *event);
+	void flush_motion();
 	void report_xi2_event(XIDeviceEvent *event, const char *type);
 
 	void fake_core_button(guint b, bool press);
 	void fake_click(guint b);
+	void queue_scroll(guint b, int n);
+	void flush_scroll();
 	void update_core_mapping();
 
 	void remove_device(int deviceid);
@@ -70,6 +73,21 @@ private:
 	int (*oldIOHandler)(Display *);
 	std::list<sigc::slot<void> > queued;
 	std::map<int, std::string> opcodes;
+
+	// Raw motion events that arrive in one pass over the event queue are
+	// merged and only passed on to the handler once the pass is over
+	// (or as soon as a different kind of event shows up)
+	struct Motion {
+		int type; // XI_RawMotion or 0 if nothing is pending
+		float x, y;
+		bool has_x, has_y;
+		bool proximity;
+		Time t;
+	} motion;
+
+	// Wheel clicks queued up by the scroll handlers, net of clicks in the
+	// opposite direction (positive means down/right)
+	int scroll_x, scroll_y;
 };
 
 class Handler {
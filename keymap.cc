@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "keymap.h"
+#include "main.h"
+#include <X11/keysym.h>
+#include <stdio.h>
+
+Keymap keymap;
+
+// How long temporary bindings stay around after the last use (ms)
+#define RESTORE_DELAY 500
+
+void Keymap::update() {
+	valid = true;
+	keys.clear();
+	spare.clear();
+	bound.clear();
+	next_spare = 0;
+
+	int min, max, n;
+	XDisplayKeycodes(dpy, &min, &max);
+	KeySym *mapping = XGetKeyboardMapping(dpy, min, max - min + 1, &n);
+	if (!mapping)
+		return;
+	per_keycode = n;
+	XModifierKeymap *modmap = XGetModifierMapping(dpy);
+
+	// The first keycode bound to each of the modifiers we need
+	KeyCode shift = modmap->modifiermap[ShiftMapIndex * modmap->max_keypermod];
+	KeyCode level3 = 0;
+	for (int i = 0; i < (max - min + 1) * n; i++)
+		if (mapping[i] == XK_ISO_Level3_Shift) {
+			level3 = min + i / n;
+			break;
+		}
+	XFreeModifiermap(modmap);
+
+	// Like XKeysymToKeycode, prefer unshifted keys
+	static const int levels[] = { 0, 1, 4, 5 };
+	for (int l = 0; l < 4; l++) {
+		int j = levels[l];
+		if (j >= n)
+			break;
+		Key key;
+		key.mods[0] = (j & 1) ? shift : 0;
+		key.mods[1] = (j & 4) ? level3 : 0;
+		if ((j & 1 && !shift) || (j & 4 && !level3))
+			continue;
+		for (int i = 0; i <= max - min; i++) {
+			KeySym sym = mapping[i*n + j];
+			if (sym == NoSymbol || keys.count(sym) || dirty.count(min + i))
+				continue;
+			key.code = min + i;
+			keys[sym] = key;
+		}
+	}
+	// Keycodes without any keysyms are free for temporary bindings
+	for (int i = 0; i <= max - min; i++) {
+		bool empty = true;
+		for (int j = 0; j < n; j++)
+			if (mapping[i*n + j] != NoSymbol)
+				empty = false;
+		if (empty || dirty.count(min + i))
+			spare.push_back(min + i);
+	}
+	XFree(mapping);
+	if (verbosity >= 2)
+		printf("Loaded keymap (%lu keysyms, %lu spare keycodes)\n",
+				(unsigned long)keys.size(), (unsigned long)spare.size());
+}
+
+bool Keymap::lookup(KeySym sym, Key &key) {
+	if (!valid)
+		update();
+	std::unordered_map<KeySym, Key>::iterator i = keys.find(sym);
+	if (i == keys.end())
+		return false;
+	key = i->second;
+	return true;
+}
+
+KeyCode Keymap::keycode(KeySym sym) {
+	Key key;
+	if (!lookup(sym, key))
+		return XKeysymToKeycode(dpy, sym);
+	return key.code;
+}
+
+bool Keymap::has_spare() {
+	if (!valid)
+		update();
+	return !spare.empty();
+}
+
+bool Keymap::bind(KeySym sym, KeyCode &code) {
+	if (!valid)
+		update();
+	std::map<KeySym, KeyCode>::iterator i = bound.find(sym);
+	if (i != bound.end()) {
+		code = i->second;
+		return true;
+	}
+	if (next_spare >= spare.size())
+		return false;
+	code = spare[next_spare++];
+	bound[sym] = code;
+	pending[code] = sym;
+	return true;
+}
+
+// Bind each keycode to the given keysym on all levels (or to nothing), with
+// one request per run of consecutive keycodes
+void Keymap::change_mapping(const std::map<KeyCode, KeySym> &codes) {
+	std::vector<KeySym> syms;
+	int first = 0, count = 0;
+	for (std::map<KeyCode, KeySym>::const_iterator i = codes.begin();; i++) {
+		if (count && (i == codes.end() || i->first != first + count)) {
+			XChangeKeyboardMapping(dpy, first, per_keycode, &syms[0], count);
+			syms.clear();
+			count = 0;
+		}
+		if (i == codes.end())
+			break;
+		if (!count)
+			first = i->first;
+		count++;
+		for (int j = 0; j < per_keycode; j++)
+			syms.push_back(j < 2 ? i->second : NoSymbol);
+	}
+}
+
+void Keymap::commit() {
+	if (pending.empty())
+		return;
+	if (verbosity >= 3)
+		printf("Binding %lu keysyms to spare keycodes\n", (unsigned long)pending.size());
+	change_mapping(pending);
+	for (std::map<KeyCode, KeySym>::iterator i = pending.begin(); i != pending.end(); i++)
+		dirty.insert(i->first);
+	pending.clear();
+	set_timeout(RESTORE_DELAY);
+}
+
+void Keymap::next_batch() {
+	bound.clear();
+	next_spare = 0;
+}
+
+void Keymap::restore() {
+	remove_timeout();
+	if (dirty.empty())
+		return;
+	std::map<KeyCode, KeySym> codes;
+	for (std::set<KeyCode>::iterator i = dirty.begin(); i != dirty.end(); i++)
+		codes[*i] = NoSymbol;
+	change_mapping(codes);
+	dirty.clear();
+	next_batch();
+	XFlush(dpy);
+}
+
+void Keymap::timeout() {
+	restore();
+}
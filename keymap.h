@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __KEYMAP_H__
+#define __KEYMAP_H__
+#include "util.h"
+#include <X11/Xlib.h>
+#include <unordered_map>
+#include <vector>
+#include <map>
+#include <set>
+
+// Client side copy of the keyboard and modifier mappings, so that looking
+// up the keys for a keysym doesn't need any round trips.  Fetched lazily
+// and thrown away on MappingNotify.
+//
+// Keysyms that aren't on the keyboard at all can be bound to unused
+// keycodes for a while.  The keycodes are handed out in batches: bind()
+// until it fails, commit() to send the new bindings to the server, type,
+// then next_batch() to start reusing them (after a short pause, as clients
+// only pick up the new mapping on MappingNotify).  The original (empty)
+// mapping is restored once nothing has been bound for a moment, giving
+// clients time to look up the temporary one, or by restore() on exit.
+class Keymap : Timeout {
+public:
+	struct Key {
+		KeyCode code;
+		KeyCode mods[2]; // modifier keys to hold down, 0 if unused
+	};
+	Keymap() : valid(false), per_keycode(0), next_spare(0) {}
+	// Find a key producing sym, returns false if there is none we can use
+	bool lookup(KeySym sym, Key &key);
+	KeyCode keycode(KeySym sym);
+	void invalidate() { valid = false; }
+
+	bool bind(KeySym sym, KeyCode &code);
+	void commit();
+	void next_batch();
+	bool has_spare();
+	void restore();
+private:
+	void update();
+	void change_mapping(const std::map<KeyCode, KeySym> &codes);
+	virtual void timeout();
+
+	bool valid;
+	int per_keycode;
+	std::unordered_map<KeySym, Key> keys;
+
+	std::vector<KeyCode> spare;
+	unsigned int next_spare;
+	std::map<KeySym, KeyCode> bound; // in the current batch
+	std::map<KeyCode, KeySym> pending; // not sent to the server yet
+	std::set<KeyCode> dirty; // to be restored
+};
+
+extern Keymap keymap;
+
+#endif
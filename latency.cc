@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "latency.h"
+#include "main.h"
+#include <glibmm.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <signal.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef LATENCY_TRACING
+
+#define LATENCY_RECORDS 65536 // a power of two
+
+struct LatencyRecord {
+	gint seq; // 0 while unused or being written
+	guint32 thread;
+	gint64 time;
+	gint64 arg;
+	guint16 stage;
+	char phase;
+};
+
+static LatencyRecord records[LATENCY_RECORDS];
+static gint next_seq = 0;
+static gint next_thread = 0;
+static thread_local guint32 thread_id = 0;
+
+static const char *stage_names[LatencyStages] = {
+	"X event", "dispatch", "stroke_finish", "filter", "stroke_compare", "prepare", "run", "XFlush"
+};
+
+// Safe to call from any thread: every record gets a slot of its own
+void latency_record(LatencyStage stage, char phase, long arg) {
+	guint seq = (guint)g_atomic_int_add(&next_seq, 1) + 1;
+	LatencyRecord &r = records[seq % LATENCY_RECORDS];
+	if (!thread_id)
+		thread_id = g_atomic_int_add(&next_thread, 1) + 1;
+	g_atomic_int_set(&r.seq, 0);
+	r.thread = thread_id;
+	r.time = g_get_monotonic_time();
+	r.arg = arg;
+	r.stage = stage;
+	r.phase = phase;
+	g_atomic_int_set(&r.seq, seq);
+}
+
+static bool by_seq(const LatencyRecord &a, const LatencyRecord &b) {
+	return (guint)a.seq < (guint)b.seq;
+}
+
+std::string latency_dump() {
+	std::vector<LatencyRecord> copy;
+	copy.reserve(LATENCY_RECORDS);
+	for (int i = 0; i < LATENCY_RECORDS; i++) {
+		LatencyRecord r = records[i];
+		if (g_atomic_int_get(&records[i].seq) == r.seq && r.seq)
+			copy.push_back(r);
+	}
+	std::sort(copy.begin(), copy.end(), by_seq);
+
+	std::string json = config_dir + "latency.json";
+	std::string bin = config_dir + "latency.bin";
+	FILE *f = fopen(json.c_str(), "w");
+	if (!f)
+		return "Error: Couldn't write " + json + "\n";
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (std::vector<LatencyRecord>::iterator i = copy.begin(); i != copy.end(); i++) {
+		fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld,\"pid\":1,\"tid\":%u",
+				i == copy.begin() ? "" : ",", stage_names[i->stage], i->phase, (long)i->time, i->thread);
+		if (i->phase == 'i')
+			fprintf(f, ",\"s\":\"t\"");
+		if (i->phase != 'E')
+			fprintf(f, ",\"args\":{\"arg\":%ld}", (long)i->arg);
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	// Header, record count, then the records as they are in memory
+	f = fopen(bin.c_str(), "wb");
+	if (!f)
+		return "Error: Couldn't write " + bin + "\n";
+	guint32 n = copy.size();
+	guint32 size = sizeof(LatencyRecord);
+	fwrite("ESLATNCY", 1, 8, f);
+	fwrite(&n, sizeof(n), 1, f);
+	fwrite(&size, sizeof(size), 1, f);
+	if (n)
+		fwrite(&copy[0], sizeof(LatencyRecord), n, f);
+	fclose(f);
+
+	return Glib::ustring::compose("Wrote %1 latency records to %2 and %3\n", n, json, bin);
+}
+
+static gboolean on_sigusr1(gpointer) {
+	printf("%s", latency_dump().c_str());
+	return TRUE;
+}
+
+void latency_init() {
+	g_unix_signal_add(SIGUSR1, &on_sigusr1, nullptr);
+}
+
+#else
+
+void latency_init() {}
+
+std::string latency_dump() {
+	return "Latency tracing is not compiled in (build with -DLATENCY_TRACING)\n";
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+#include <string>
+
+// Timestamps for the stages an input event goes through, recorded into a
+// ring buffer that can be written out for chrome://tracing.  Only compiled
+// in with -DLATENCY_TRACING (e.g. "make DFLAGS=-DLATENCY_TRACING"),
+// otherwise the macros below expand to nothing.
+
+enum LatencyStage {
+	LatencyXEvent,
+	LatencyDispatch,
+	LatencyStrokeFinish,
+	LatencyFilter,
+	LatencyCompare,
+	LatencyPrepare,
+	LatencyRun,
+	LatencyFlush,
+	LatencyStages
+};
+
+#ifdef LATENCY_TRACING
+// phase is 'B' (begin), 'E' (end) or 'i' (instant), like in the trace format
+void latency_record(LatencyStage stage, char phase, long arg);
+
+class LatencyScope {
+	LatencyStage stage;
+public:
+	LatencyScope(LatencyStage stage_, long arg = 0) : stage(stage_) { latency_record(stage, 'B', arg); }
+	~LatencyScope() { latency_record(stage, 'E', 0); }
+};
+
+#define LATENCY_EVENT(stage, arg) latency_record(stage, 'i', arg)
+#define LATENCY_SCOPE(stage) LatencyScope latency_scope(stage)
+#else
+#define LATENCY_EVENT(stage, arg) ((void)0)
+#define LATENCY_SCOPE(stage) ((void)0)
+#endif
+
+// Dump on SIGUSR1
+void latency_init();
+// Writes latency.json and latency.bin to the config directory and returns
+// a message saying so
+std::string latency_dump();
+
+#endif
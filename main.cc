@@ -26,6 +26,9 @@
 #include "composite.h"
 #include "grabber.h"
 #include "handler.h"
+#include "keymap.h"
+#include "spawn.h"
+#include "latency.h"
 
 #include <glibmm/i18n.h>
 
@@ -40,7 +43,11 @@
 
 extern Source<bool> disabled;
 
+int Atomic::depth = 0;
+std::vector<Base *> Atomic::queue;
+
 bool experimental = false;
+static bool use_launcher = false;
 int verbosity = 0;
 const char *prefs_versions[] = { "-0.5.5", "-0.4.1", "-0.4.0", "", nullptr };
 const char *actions_versions[] = { "-0.5.6", "-0.4.1", "-0.4.0", "", nullptr };
@@ -166,6 +173,11 @@ void quit() {
 	xstate->queue(sigc::mem_fun(*app.operator->(), &Gio::Application::quit));
 }
 
+void save_config() {
+	prefs.execute_now();
+	action_watcher->execute_now();
+}
+
 void sig_int(int) {
 	quit();
 }
@@ -218,6 +230,8 @@ bool App::local_command_line_vfunc (char**& arg, int& exit_status) {
 		if (arg[i][1] == '-') {
 			if (!strcmp(arg[i], "--experimental")) {
 				experimental = true;
+			} else if (!strcmp(arg[i], "--launcher")) {
+				use_launcher = true;
 			} else if (!strcmp(arg[i], "--verbose")) {
 				verbosity++;
 			} else if (!strcmp(arg[i], "--help")) {
@@ -235,6 +249,15 @@ bool App::local_command_line_vfunc (char**& arg, int& exit_status) {
 					return true;
 				}
 				config_dir = arg[i];
+			} else if (!strcmp(arg[i], "--ranking-size")) {
+				if (!arg[++i] || atoi(arg[i]) < 0) {
+					printf("Error: Option --ranking-size requires a number.\n");
+					exit_status = EXIT_FAILURE;
+					return true;
+				}
+				Ranking::max_size = atoi(arg[i]);
+				if (Ranking::max_size > Ranking::MAX_SIZE)
+					Ranking::max_size = Ranking::MAX_SIZE;
 			} else {
 				printf("Error: Unknown option %s\n", arg[i]);
 				exit_status = EXIT_FAILURE;
@@ -254,6 +277,9 @@ bool App::local_command_line_vfunc (char**& arg, int& exit_status) {
 					case 'e':
 						experimental = true;
 						break;
+					case 'l':
+						use_launcher = true;
+						break;
 					case 'v':
 						verbosity++;
 						break;
@@ -323,6 +349,8 @@ int App::on_command_line(const Glib::RefPtr<Gio::ApplicationCommandLine> &comman
 			disabled.set(false);
 		} else if (!strcmp(arg[i], "about")) {
 			win->show_about();
+		} else if (!strcmp(arg[i], "stats")) {
+			command_line->print(latency_dump());
 		} else if (!strcmp(arg[i], "quit")) {
 			quit();
 		} else {
@@ -377,9 +405,11 @@ void App::on_activate() {
 
 	create_config_dir();
 	unsetenv("DESKTOP_AUTOSTART_ID");
+	if (use_launcher)
+		start_launcher();
+	latency_init();
 
 	signal(SIGINT, &sig_int);
-	signal(SIGCHLD, SIG_IGN);
 
 	dpy = XOpenDisplay(nullptr);
 	if (!dpy) {
@@ -441,11 +471,14 @@ void App::usage(const char *me) {
 	printf("  disable                Disable easystroke\n");
 	printf("  enable                 Enable easystroke\n");
 	printf("  about                  Show about dialog\n");
+	printf("  stats                  Write the latency trace to the config directory\n");
 	printf("  quit                   Quit easystroke\n");
 	printf("\n");
 	printf("Options:\n");
 	printf("  -c, --config-dir <dir> Directory for config files\n");
 	printf("  -e  --experimental     Start in experimental mode\n");
+	printf("  -l, --launcher         Run commands from a separate launcher process\n");
+	printf("      --ranking-size <n> Number of candidates listed in the History tab (at most 32)\n");
 	printf("  -v, --verbose          Increase verbosity level\n");
 	printf("  -h, --help             Display this help and exit\n");
 	printf("      --version          Output version information and exit\n");
@@ -490,14 +523,17 @@ App::~App() {
 		delete win;
 		trace->end();
 		trace.reset();
+		stop_launcher();
 		delete grabber;
+		keymap.restore();
 		XCloseDisplay(dpy);
-		prefs.execute_now();
-		action_watcher->execute_now();
+		save_config();
 	}
 }
 
 int main(int argc, char **argv) {
+	if (argc == 3 && !strcmp(argv[1], "--launcher-helper"))
+		run_launcher(atoi(argv[2]));
 	if (0) {
 		RStroke trefoil = Stroke::trefoil();
 		trefoil->draw_svg("easystroke.svg");
@@ -527,7 +563,13 @@ void Button::run() {
 void SendKey::run() {
 	if (!key)
 		return;
-	guint code = XKeysymToKeycode(dpy, key);
+	guint code = keymap.keycode(key);
+	XTestFakeKeyEvent(dpy, code, true, 0);
+	XTestFakeKeyEvent(dpy, code, false, 0);
+}
+
+static void fake_key(KeySym sym) {
+	KeyCode code = keymap.keycode(sym);
 	XTestFakeKeyEvent(dpy, code, true, 0);
 	XTestFakeKeyEvent(dpy, code, false, 0);
 }
@@ -541,63 +583,107 @@ void fake_unicode(gunichar c) {
 		buf[g_unichar_to_utf8(c, buf)] = '\0';
 		printf("using unicode input for character %s\n", buf);
 	}
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_Control_L), true, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_Shift_L), true, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_u), true, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_u), false, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_Shift_L), false, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_Control_L), false, 0);
+	KeyCode control = keymap.keycode(XK_Control_L);
+	KeyCode shift = keymap.keycode(XK_Shift_L);
+	XTestFakeKeyEvent(dpy, control, true, 0);
+	XTestFakeKeyEvent(dpy, shift, true, 0);
+	fake_key(XK_u);
+	XTestFakeKeyEvent(dpy, shift, false, 0);
+	XTestFakeKeyEvent(dpy, control, false, 0);
 	char buf[16];
 	snprintf(buf, sizeof(buf), "%x", c);
 	for (int i = 0; buf[i]; i++)
-		if (buf[i] >= '0' && buf[i] <= '9') {
-			XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, numcode[buf[i]-'0']), true, 0);
-			XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, numcode[buf[i]-'0']), false, 0);
-		} else if (buf[i] >= 'a' && buf[i] <= 'f') {
-			XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, hexcode[buf[i]-'a']), true, 0);
-			XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, hexcode[buf[i]-'a']), false, 0);
-		}
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_space), true, 0);
-	XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_space), false, 0);
+		if (buf[i] >= '0' && buf[i] <= '9')
+			fake_key(numcode[buf[i]-'0']);
+		else if (buf[i] >= 'a' && buf[i] <= 'f')
+			fake_key(hexcode[buf[i]-'a']);
+	fake_key(XK_space);
 }
 
-bool fake_char(gunichar c) {
+static KeySym char_to_keysym(gunichar c) {
 	char buf[16];
 	snprintf(buf, sizeof(buf), "U%04X", c);
-	KeySym keysym = XStringToKeysym(buf);
+	return XStringToKeysym(buf);
+}
+
+static void fake_keycode(KeyCode code, const KeyCode *mods) {
+	for (int i = 0; i < 2; i++)
+		if (mods[i])
+			XTestFakeKeyEvent(dpy, mods[i], true, 0);
+	XTestFakeKeyEvent(dpy, code, true, 0);
+	XTestFakeKeyEvent(dpy, code, false, 0);
+	for (int i = 1; i >= 0; i--)
+		if (mods[i])
+			XTestFakeKeyEvent(dpy, mods[i], false, 0);
+}
+
+bool fake_char(gunichar c) {
+	KeySym keysym = char_to_keysym(c);
 	if (keysym == NoSymbol)
 		return false;
-	KeyCode keycode = XKeysymToKeycode(dpy, keysym);
-	if (!keycode)
+	Keymap::Key key;
+	if (!keymap.lookup(keysym, key))
 		return false;
-	KeyCode modifier = 0;
-	int n;
-	KeySym *mapping = XGetKeyboardMapping(dpy, keycode, 1, &n);
-	if (mapping[0] != keysym) {
-		int i;
-		for (i = 1; i < n; i++)
-			if (mapping[i] == keysym)
-				break;
-		if (i == n)
-			return false;
-		XModifierKeymap *keymap = XGetModifierMapping(dpy);
-		modifier = keymap->modifiermap[i];
-		XFreeModifiermap(keymap);
-	}
-	XFree(mapping);
-	if (modifier)
-		XTestFakeKeyEvent(dpy, modifier, true, 0);
-	XTestFakeKeyEvent(dpy, keycode, true, 0);
-	XTestFakeKeyEvent(dpy, keycode, false, 0);
-	if (modifier)
-		XTestFakeKeyEvent(dpy, modifier, false, 0);
+	fake_keycode(key.code, key.mods);
 	return true;
 }
 
-void SendText::run() {
-	for (Glib::ustring::iterator i = text.begin(); i != text.end(); i++)
-		if (!fake_char(*i))
+// Longest run of characters sent without a pause
+#define TEXT_CHUNK 256
+// Pause between batches (ms), so that clients have typed the previous batch
+// and seen the new bindings before their keycodes get reused
+#define BATCH_DELAY 50
+
+// Characters that aren't on the keyboard are bound to spare keycodes, as
+// many at a time as there are spare keycodes.  Only if there aren't any do
+// we resort to unicode input.  Text that doesn't fit into one batch is
+// typed from a timeout, so the main loop keeps running in between.
+class TextTyper : Timeout {
+	Glib::ustring text;
+	virtual void timeout();
+public:
+	void type(const Glib::ustring &s) {
+		bool busy = !text.empty();
+		text += s;
+		if (!busy)
+			timeout();
+	}
+} typer;
+
+void TextTyper::timeout() {
+	static const KeyCode no_mods[2] = { 0, 0 };
+	keymap.next_batch();
+	Glib::ustring::iterator i, j;
+	int n = 0;
+	for (j = text.begin(); j != text.end() && n < TEXT_CHUNK; j++, n++) {
+		KeySym keysym = char_to_keysym(*j);
+		Keymap::Key key;
+		KeyCode code;
+		if (keysym != NoSymbol && !keymap.lookup(keysym, key) && !keymap.bind(keysym, code) && keymap.has_spare())
+			break;
+	}
+	keymap.commit();
+	for (i = text.begin(); i != j; i++) {
+		KeySym keysym = char_to_keysym(*i);
+		Keymap::Key key;
+		KeyCode code;
+		if (keysym == NoSymbol)
 			fake_unicode(*i);
+		else if (keymap.lookup(keysym, key))
+			fake_keycode(key.code, key.mods);
+		else if (keymap.bind(keysym, code))
+			fake_keycode(code, no_mods);
+		else
+			fake_unicode(*i);
+	}
+	text.erase(text.begin(), j);
+	XFlush(dpy);
+	if (!text.empty())
+		set_timeout(BATCH_DELAY);
+}
+
+void SendText::run() {
+	typer.type(text);
 }
 
 static struct {
@@ -615,21 +701,45 @@ static struct {
 	{GDK_HYPER_MASK, XK_Hyper_L},
 	{GDK_META_MASK, XK_Meta_L},
 };
-static int n_modkeys = 10;
+#define N_MODKEYS 10
+
+// How many Modifiers objects want each of the modifiers held down and the
+// keycode we pressed for it, so that it can be released even if the
+// mapping changed in the meantime
+static int mod_count[N_MODKEYS];
+static KeyCode mod_held[N_MODKEYS];
 
 class Modifiers : Timeout {
-	static std::set<Modifiers *> all;
-	static void update_mods() {
-		static guint mod_state = 0;
-		guint new_state = 0;
-		for (std::set<Modifiers *>::iterator i = all.begin(); i != all.end(); i++)
-			new_state |= (*i)->mods;
-		for (int i = 0; i < n_modkeys; i++) {
-			guint mask = modkeys[i].mask;
-			if ((mod_state & mask) ^ (new_state & mask))
-				XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, modkeys[i].sym), new_state & mask, 0);
+	static void acquire(guint mods) {
+		bool changed = false;
+		for (int i = 0; i < N_MODKEYS; i++) {
+			if (!(mods & modkeys[i].mask) || !modkeys[i].sym)
+				continue;
+			if (mod_count[i]++)
+				continue;
+			KeyCode code = keymap.keycode(modkeys[i].sym);
+			if (!code)
+				continue;
+			XTestFakeKeyEvent(dpy, code, true, 0);
+			mod_held[i] = code;
+			changed = true;
+		}
+		if (changed)
+			XFlush(dpy);
+	}
+	static void release(guint mods) {
+		bool changed = false;
+		for (int i = 0; i < N_MODKEYS; i++) {
+			if (!(mods & modkeys[i].mask) || !modkeys[i].sym)
+				continue;
+			if (--mod_count[i] || !mod_held[i])
+				continue;
+			XTestFakeKeyEvent(dpy, mod_held[i], false, 0);
+			mod_held[i] = 0;
+			changed = true;
 		}
-		mod_state = new_state;
+		if (changed)
+			XFlush(dpy);
 	}
 
 	guint mods;
@@ -639,8 +749,7 @@ public:
 	Modifiers(guint mods_, Glib::ustring str_) : mods(mods_), str(str_), osd(nullptr) {
 		if (prefs.show_osd.get())
 			set_timeout(150);
-		all.insert(this);
-		update_mods();
+		acquire(mods);
 	}
 	bool operator==(const Modifiers &m) {
 		return mods == m.mods && str == m.str;
@@ -649,12 +758,10 @@ public:
 		osd = new OSD(str);
 	}
 	~Modifiers() {
-		all.erase(this);
-		update_mods();
+		release(mods);
 		delete osd;
 	}
 };
-std::set<Modifiers *> Modifiers::all;
 
 RModifiers ModAction::prepare() {
 	return RModifiers(new Modifiers(mods, get_label()));
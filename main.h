@@ -22,6 +22,7 @@
 bool is_file(std::string filename);
 bool is_dir(std::string dirname);
 void quit();
+void save_config();
 
 extern std::string config_dir;
 extern const char *prefs_versions[];
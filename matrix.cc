@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "matrix.h"
+#include "main.h"
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+// Scores of the last run, keyed by the ids of both strokes (lower id first).
+// Only touched from the main loop.
+static std::map<std::pair<unsigned int, unsigned int>, MatrixJob::Cell> cache;
+
+static std::pair<unsigned int, unsigned int> cache_key(const RStroke &a, const RStroke &b) {
+	unsigned int i = a->get_id(), j = b->get_id();
+	return i < j ? std::make_pair(i, j) : std::make_pair(j, i);
+}
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+	return s.size() >= suffix.size() && !s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+static const int S = 32;
+static const int B = 1;
+
+MatrixJob::MatrixJob(const std::list<RStroke> &strokes_, const std::string &filename_,
+		sigc::slot<void, int, int> progress_, sigc::slot<void, bool> finished_) :
+	strokes(strokes_.begin(), strokes_.end()), filename(filename_),
+	progress(progress_), finished(finished_), thread(nullptr),
+	next_row(0), done(0), complete(0), ok(false)
+{
+	const int n = strokes.size();
+	cells.resize(n*n);
+	known.resize(n*n);
+	total = n*(n+1)/2;
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++) {
+			std::map<std::pair<unsigned int, unsigned int>, Cell>::iterator c = cache.find(cache_key(strokes[i], strokes[j]));
+			if (c == cache.end())
+				continue;
+			cells[i*n+j] = c->second;
+			known[i*n+j] = true;
+		}
+
+	if (ends_with(filename, ".pdf"))
+		format = PDF;
+	else if (ends_with(filename, ".csv"))
+		format = CSV;
+	else
+		format = BINARY;
+
+	// Drawing strokes may involve gtk, so the headers are done here
+	if (format == PDF) {
+		surface = Cairo::PdfSurface::create(filename, (n+1)*S, (n+1)*S);
+		const Cairo::RefPtr<Cairo::Context> ctx = Cairo::Context::create(surface);
+		for (int k = 1; k <= n; k++) {
+			strokes[k-1]->draw(surface, k*S+B, B, S-2*B, S-2*B);
+			strokes[k-1]->draw(surface, B, k*S+B, S-2*B, S-2*B);
+
+			ctx->set_source_rgba(0,0,0,1);
+			ctx->set_line_width(1);
+			ctx->move_to(k*S, B);
+			ctx->line_to(k*S, (n+1)*S-B);
+			ctx->move_to(B, k*S);
+			ctx->line_to((n+1)*S-B, k*S);
+			ctx->stroke();
+		}
+	}
+
+	thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &MatrixJob::run));
+	poll_connection = Glib::signal_timeout().connect(sigc::mem_fun(*this, &MatrixJob::poll), 100);
+}
+
+MatrixJob::~MatrixJob() {
+	poll_connection.disconnect();
+	if (thread) {
+		g_atomic_int_set(&next_row, strokes.size());
+		thread->join();
+	}
+}
+
+void MatrixJob::work() {
+	const int n = strokes.size();
+	for (;;) {
+		int i = g_atomic_int_add(&next_row, 1);
+		if (i >= n)
+			return;
+		for (int j = i; j < n; j++)
+			if (!known[i*n+j]) {
+				Cell &c = cells[i*n+j];
+				c.match = Stroke::compare(strokes[i], strokes[j], c.score);
+			}
+		g_atomic_int_add(&done, n - i);
+	}
+}
+
+void MatrixJob::run() {
+	gint64 start = g_get_monotonic_time();
+	std::vector<Glib::Threads::Thread *> workers;
+	for (int i = 1; i < (int)g_get_num_processors(); i++)
+		workers.push_back(Glib::Threads::Thread::create(sigc::mem_fun(*this, &MatrixJob::work)));
+	work();
+	for (std::vector<Glib::Threads::Thread *>::iterator i = workers.begin(); i != workers.end(); i++)
+		(*i)->join();
+	const int n = strokes.size();
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < i; j++)
+			cells[i*n+j] = cells[j*n+i];
+	if (verbosity >= 1)
+		printf("creating table took %ld us\n", (long)(g_get_monotonic_time() - start));
+	ok = write();
+	g_atomic_int_set(&complete, 1);
+}
+
+void MatrixJob::draw_pdf() {
+	const int n = strokes.size();
+	const Cairo::RefPtr<Cairo::Context> ctx = Cairo::Context::create(surface);
+	ctx->set_source_rgba(0,0,0,1);
+	for (int k = 1; k <= n; k++)
+		for (int l = 1; l <= n; l++) {
+			const Cell &c = cells[(k-1)*n+(l-1)];
+			if (c.match < 0)
+				continue;
+			if (c.match) {
+				ctx->save();
+				ctx->set_source_rgba(0,0,1,c.score-0.6);
+				ctx->rectangle(l*S, k*S, S, S);
+				ctx->fill();
+				ctx->restore();
+			}
+			Glib::ustring str = Glib::ustring::format(std::fixed, std::setprecision(2), c.score);
+			Cairo::TextExtents te;
+			ctx->get_text_extents(str, te);
+			ctx->move_to(l*S+S/2 - te.x_bearing - te.width/2, k*S+S/2 - te.y_bearing - te.height/2);
+			ctx->show_text(str);
+		}
+}
+
+bool MatrixJob::write() {
+	const int n = strokes.size();
+	try {
+		if (format == PDF) {
+			draw_pdf();
+			surface->finish();
+			surface.clear();
+			return true;
+		}
+		std::ofstream ofs(filename.c_str(), std::ios::binary);
+		if (format == CSV) {
+			for (int i = 0; i < n; i++) {
+				for (int j = 0; j < n; j++) {
+					if (j)
+						ofs << ',';
+					if (cells[i*n+j].match >= 0)
+						ofs << std::fixed << std::setprecision(4) << cells[i*n+j].score;
+				}
+				ofs << '\n';
+			}
+		} else {
+			// "ESMATRIX", the number of strokes as a 32 bit integer and
+			// then match (8 bit) and score (double) for each cell
+			guint32 size = n;
+			ofs.write("ESMATRIX", 8);
+			ofs.write((const char *)&size, sizeof(size));
+			for (int i = 0; i < n*n; i++) {
+				gint8 match = cells[i].match;
+				ofs.write((const char *)&match, sizeof(match));
+				ofs.write((const char *)&cells[i].score, sizeof(cells[i].score));
+			}
+		}
+		ofs.close();
+		return !ofs.fail();
+	} catch (std::exception &e) {
+		printf("Error: Couldn't write %s: %s\n", filename.c_str(), e.what());
+		return false;
+	}
+}
+
+bool MatrixJob::poll() {
+	if (!g_atomic_int_get(&complete)) {
+		progress(g_atomic_int_get(&done), total);
+		return true;
+	}
+	thread->join();
+	thread = nullptr;
+	cache.clear();
+	const int n = strokes.size();
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++)
+			cache[cache_key(strokes[i], strokes[j])] = cells[i*n+j];
+	// finished() is allowed to delete us
+	sigc::slot<void, bool> f = finished;
+	f(ok);
+	return false;
+}
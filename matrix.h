@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+#include "gesture.h"
+#include <glibmm.h>
+#include <cairomm/cairomm.h>
+#include <list>
+#include <string>
+#include <vector>
+
+// Compares every stroke against every other one in the background and
+// writes the result to a file: a PDF table for .pdf, comma separated scores
+// for .csv and a raw dump for anything else.  Only the upper triangle is
+// computed, compare() is symmetric up to rounding.  Scores are cached by
+// stroke id, so running the job again only compares new strokes.
+class MatrixJob {
+public:
+	enum Format { PDF, CSV, BINARY };
+	struct Cell {
+		int match; // as returned by Stroke::compare
+		double score;
+	};
+	// progress(done, total) and finished(ok) are called from the main loop
+	MatrixJob(const std::list<RStroke> &strokes, const std::string &filename,
+			sigc::slot<void, int, int> progress, sigc::slot<void, bool> finished);
+	~MatrixJob();
+	Format get_format() const { return format; }
+	const std::string &get_filename() const { return filename; }
+private:
+	std::vector<RStroke> strokes;
+	std::vector<Cell> cells;
+	std::vector<bool> known;
+	std::string filename;
+	Format format;
+	Cairo::RefPtr<Cairo::PdfSurface> surface;
+	sigc::slot<void, int, int> progress;
+	sigc::slot<void, bool> finished;
+	Glib::Threads::Thread *thread;
+	sigc::connection poll_connection;
+	gint next_row;
+	gint done;
+	gint total;
+	gint complete;
+	bool ok;
+
+	void run();
+	void work();
+	bool write();
+	void draw_pdf();
+	bool poll();
+};
+
+#endif
@@ -52,7 +52,8 @@ PrefDB::PrefDB() :
 	tray_feedback(false),
 	show_osd(true),
 	move_back(false),
-	whitelist(false)
+	whitelist(false),
+	replay_path(true)
 {}
 
 template<class Archive> void PrefDB::serialize(Archive & ar, const unsigned int version) {
@@ -138,6 +139,10 @@ template<class Archive> void PrefDB::serialize(Archive & ar, const unsigned int
 	ar & device_timeout.unsafe_ref();
 	if (version < 18) return;
 	ar & whitelist.unsafe_ref();
+	if (version < 19) return;
+	ar & device_scroll_speed.unsafe_ref();
+	if (version < 20) return;
+	ar & replay_path.unsafe_ref();
 }
 
 void PrefDB::timeout() {
@@ -133,12 +133,14 @@ public:
 	PrefSource<bool> move_back;
 	PrefSource<std::map<std::string, TimeoutType> > device_timeout;
 	PrefSource<bool> whitelist;
+	PrefSource<std::map<std::string, double> > device_scroll_speed;
+	PrefSource<bool> replay_path;
 
 	void init();
 	virtual void timeout();
 };
 
-BOOST_CLASS_VERSION(PrefDB, 18)
+BOOST_CLASS_VERSION(PrefDB, 20)
 
 extern PrefDB prefs;
 
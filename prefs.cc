@@ -272,6 +272,7 @@ Prefs::Prefs() {
 	new Adjustment<double>(prefs.scroll_speed, "adjustment_scroll_speed");
 
 	new Check(prefs.move_back, "check_move_back");
+	new Check(prefs.replay_path, "check_replay_path");
 
 	new Check(prefs.show_osd, "check_osd");
 
@@ -336,6 +337,13 @@ Prefs::Prefs() {
 	Gtk::TreeView::Column *col_timeout = dtv->get_column(n-1);
 	col_timeout->add_attribute(timeout_renderer->property_text(), dcs.timeout);
 
+	Gtk::CellRendererText *scroll_renderer = Gtk::manage(new Gtk::CellRendererText);
+	scroll_renderer->property_editable() = true;
+	scroll_renderer->signal_edited().connect(sigc::mem_fun(*this, &Prefs::on_device_scroll_speed_changed));
+	n = dtv->append_column(_("Scroll speed"), *scroll_renderer);
+	Gtk::TreeView::Column *col_scroll = dtv->get_column(n-1);
+	col_scroll->add_attribute(scroll_renderer->property_text(), dcs.scroll_speed);
+
 	dtm->signal_row_changed().connect(sigc::mem_fun(*this, &Prefs::on_device_toggled));
 	update_device_list();
 
@@ -388,6 +396,12 @@ void Prefs::update_device_list() {
 			for (const Combo<TimeoutType>::Info *i = timeout_info; i->name; i++)
 				if (j->second == i->value)
 					row[dcs.timeout] = i->name;
+
+		row[dcs.scroll_speed] = _("<unchanged>");
+		const std::map<std::string, double> &ds = prefs.device_scroll_speed.ref();
+		std::map<std::string, double>::const_iterator k = ds.find(name);
+		if (k != ds.end())
+			row[dcs.scroll_speed] = Glib::ustring::format(k->second);
 	}
 	ignore_device_toggled = false;
 	frame_tablet->set_visible(proximity);
@@ -701,6 +715,25 @@ void Prefs::on_device_timeout_changed(const Glib::ustring& path, const Glib::ust
 	dt.erase(device);
 }
 
+void Prefs::on_device_scroll_speed_changed(const Glib::ustring& path, const Glib::ustring& new_text) {
+	Gtk::TreeRow row(*dtm->get_iter(path));
+	Glib::ustring device = row[dcs.name];
+	Atomic a;
+
+	char *end;
+	double speed = g_ascii_strtod(new_text.c_str(), &end);
+	if (end != new_text.c_str() && !*end && speed > 0.0) {
+		std::map<std::string, double> &ds = prefs.device_scroll_speed.write_ref(a);
+		ds[device] = speed;
+		row[dcs.scroll_speed] = Glib::ustring::format(speed);
+		return;
+	}
+
+	row[dcs.scroll_speed] = _("<unchanged>");
+	std::map<std::string, double> &ds = prefs.device_scroll_speed.write_ref(a);
+	ds.erase(device);
+}
+
 void Prefs::set_button_label() {
 	blabel->set_text(prefs.button.ref().get_button_text());
 }
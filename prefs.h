@@ -39,6 +39,7 @@ public:
 private:
 	void on_device_toggled(const Gtk::TreeModel::Path& path, const Gtk::TreeModel::iterator& iter);
 	void on_device_timeout_changed(const Glib::ustring& path, const Glib::ustring& new_text);
+	void on_device_scroll_speed_changed(const Glib::ustring& path, const Glib::ustring& new_text);
 	bool select_row(const Gtk::TreeModel::Path& path, const Gtk::TreeModel::iterator& iter, std::string name);
 
 	class ExceptionColumns : public Gtk::TreeModel::ColumnRecord {
@@ -60,10 +61,11 @@ private:
 
 	class DeviceColumns : public Gtk::TreeModel::ColumnRecord {
 	public:
-		DeviceColumns() { add(enabled); add(name); add(timeout); }
+		DeviceColumns() { add(enabled); add(name); add(timeout); add(scroll_speed); }
 		Gtk::TreeModelColumn<bool> enabled;
 		Gtk::TreeModelColumn<Glib::ustring> name;
 		Gtk::TreeModelColumn<Glib::ustring> timeout;
+		Gtk::TreeModelColumn<Glib::ustring> scroll_speed;
 	};
 	DeviceColumns dcs;
 	Gtk::TreeView* dtv;
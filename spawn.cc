@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "spawn.h"
+#include "main.h"
+#include <glibmm.h>
+#include <glibmm/i18n.h>
+#include <map>
+#include <spawn.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define MAX_MESSAGE 65536
+
+// What the launcher tells us about a job
+struct LauncherReply {
+	guint32 id;
+	gint32 type; // LAUNCHER_STARTED or LAUNCHER_EXITED
+	gint32 value; // pid (or -errno) or wait status
+	gint64 latency; // us
+};
+#define LAUNCHER_STARTED 0
+#define LAUNCHER_EXITED 1
+
+struct CommandState {
+	int running;
+	gint64 last_start;
+	int debounce;
+	CommandState() : running(0), last_start(0), debounce(0) {}
+};
+
+struct Job {
+	std::string cmd;
+	const void *owner;
+	gint64 start;
+};
+
+// Keyed by owner, so that actions running the same command don't share limits
+static std::map<const void *, CommandState> commands;
+static std::map<guint32, Job> launcher_jobs;
+static guint32 next_id = 0;
+
+static int launcher_fd = -1;
+static sigc::connection launcher_io;
+
+static void log_status(const std::string &cmd, int status, gint64 start) {
+	if (verbosity < 2)
+		return;
+	gint64 ms = (g_get_monotonic_time() - start) / 1000;
+	if (WIFEXITED(status))
+		printf("Command \"%s\" exited with status %d after %ld ms\n", cmd.c_str(), WEXITSTATUS(status), (long)ms);
+	else if (WIFSIGNALED(status))
+		printf("Command \"%s\" killed by signal %d after %ld ms\n", cmd.c_str(), WTERMSIG(status), (long)ms);
+}
+
+static void job_done(const void *owner) {
+	std::map<const void *, CommandState>::iterator i = commands.find(owner);
+	if (i == commands.end())
+		return;
+	if (--i->second.running <= 0 && g_get_monotonic_time() - i->second.last_start >= i->second.debounce*1000)
+		commands.erase(i);
+}
+
+static void on_child_exit(GPid pid, int status, std::string cmd, const void *owner, gint64 start) {
+	log_status(cmd, status, start);
+	job_done(owner);
+	g_spawn_close_pid(pid);
+}
+
+static int spawn_sh(const char *cmd, const std::vector<const char *> &extra) {
+	// Entries in extra take precedence over the inherited ones
+	std::vector<const char *> envp;
+	for (char **e = environ; *e; e++) {
+		const char *eq = strchr(*e, '=');
+		size_t len = eq ? eq - *e + 1 : strlen(*e);
+		bool overridden = false;
+		for (std::vector<const char *>::const_iterator i = extra.begin(); i != extra.end(); i++)
+			if (!strncmp(*e, *i, len)) {
+				overridden = true;
+				break;
+			}
+		if (!overridden)
+			envp.push_back(*e);
+	}
+	envp.insert(envp.end(), extra.begin(), extra.end());
+	envp.push_back(nullptr);
+
+	// Signals we ignore or block would stay that way in the child
+	posix_spawnattr_t attr;
+	sigset_t def, mask;
+	posix_spawnattr_init(&attr);
+	sigemptyset(&def);
+	sigaddset(&def, SIGCHLD);
+	sigaddset(&def, SIGPIPE);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigdefault(&attr, &def);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	const char *argv[] = { "sh", "-c", cmd, nullptr };
+	pid_t pid;
+	int err = posix_spawn(&pid, "/bin/sh", nullptr, &attr, (char **)argv, (char **)&envp[0]);
+	posix_spawnattr_destroy(&attr);
+	if (err) {
+		printf(_("Error: can't execute command \"%s\": %s\n"), cmd, strerror(err));
+		return -err;
+	}
+	return pid;
+}
+
+static bool send_to_launcher(const std::string &cmd, const std::vector<std::string> &env, const void *owner, gint64 start) {
+	// The message is a job id followed by the command and the environment,
+	// each terminated by a null byte
+	guint32 id = next_id++;
+	std::string msg((const char *)&id, sizeof(id));
+	msg += cmd;
+	msg.push_back('\0');
+	for (std::vector<std::string>::const_iterator i = env.begin(); i != env.end(); i++) {
+		msg += *i;
+		msg.push_back('\0');
+	}
+	if (msg.size() > MAX_MESSAGE || send(launcher_fd, msg.data(), msg.size(), MSG_NOSIGNAL) != (ssize_t)msg.size())
+		return false;
+	Job &job = launcher_jobs[id];
+	job.cmd = cmd;
+	job.owner = owner;
+	job.start = start;
+	return true;
+}
+
+void spawn_command(const std::string &cmd, const std::vector<std::string> &env, const void *owner, int max_running, int debounce) {
+	gint64 now = g_get_monotonic_time();
+	CommandState &state = commands[owner];
+	if (debounce && state.last_start && now - state.last_start < debounce*1000) {
+		printf(_("Ignoring command \"%s\": triggered again after %ld ms\n"),
+				cmd.c_str(), (long)(now - state.last_start) / 1000);
+		return;
+	}
+	if (max_running && state.running >= max_running) {
+		printf(_("Ignoring command \"%s\": %d instances still running\n"), cmd.c_str(), state.running);
+		return;
+	}
+	state.last_start = now;
+	state.debounce = debounce;
+
+	if (launcher_fd >= 0) {
+		if (send_to_launcher(cmd, env, owner, now)) {
+			state.running++;
+			return;
+		}
+		if (verbosity >= 1)
+			printf("Warning: Launcher unavailable, spawning commands directly\n");
+		stop_launcher();
+	}
+	std::vector<const char *> extra;
+	for (std::vector<std::string>::const_iterator i = env.begin(); i != env.end(); i++)
+		extra.push_back(i->c_str());
+	int pid = spawn_sh(cmd.c_str(), extra);
+	if (pid < 0)
+		return;
+	state.running++;
+	if (verbosity >= 2)
+		printf("Spawned \"%s\" (pid %d) in %ld us\n", cmd.c_str(), pid, (long)(g_get_monotonic_time() - now));
+	Glib::signal_child_watch().connect(sigc::bind(sigc::ptr_fun(&on_child_exit), cmd, owner, now), pid);
+}
+
+static bool on_launcher_reply(Glib::IOCondition) {
+	LauncherReply r;
+	ssize_t n;
+	while ((n = recv(launcher_fd, &r, sizeof(r), MSG_DONTWAIT)) == sizeof(r)) {
+		std::map<guint32, Job>::iterator i = launcher_jobs.find(r.id);
+		if (i == launcher_jobs.end())
+			continue;
+		if (r.type == LAUNCHER_STARTED && r.value > 0) {
+			if (verbosity >= 2)
+				printf("Spawned \"%s\" (pid %d) through launcher in %ld us (%ld us in posix_spawn)\n",
+						i->second.cmd.c_str(), r.value, (long)(g_get_monotonic_time() - i->second.start), (long)r.latency);
+			continue;
+		}
+		if (r.type == LAUNCHER_EXITED)
+			log_status(i->second.cmd, r.value, i->second.start);
+		job_done(i->second.owner);
+		launcher_jobs.erase(i);
+	}
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+		stop_launcher();
+		return false;
+	}
+	return true;
+}
+
+static void on_launcher_exit(GPid pid, int status) {
+	if (verbosity >= 2)
+		printf("Launcher exited\n");
+	g_spawn_close_pid(pid);
+}
+
+void start_launcher() {
+	if (launcher_fd >= 0)
+		return;
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+		printf("Warning: Couldn't create launcher socket\n");
+		return;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	char fd[16];
+	snprintf(fd, sizeof(fd), "%d", fds[1]);
+	const char *argv[] = { "easystroke", "--launcher-helper", fd, nullptr };
+	pid_t pid;
+	int err = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, (char **)argv, environ);
+	close(fds[1]);
+	if (err) {
+		printf("Warning: Couldn't start launcher: %s\n", strerror(err));
+		close(fds[0]);
+		return;
+	}
+	launcher_fd = fds[0];
+	launcher_io = Glib::signal_io().connect(sigc::ptr_fun(&on_launcher_reply), launcher_fd, Glib::IO_IN | Glib::IO_HUP);
+	Glib::signal_child_watch().connect(sigc::ptr_fun(&on_launcher_exit), pid);
+	if (verbosity >= 2)
+		printf("Started launcher (pid %d)\n", pid);
+}
+
+void stop_launcher() {
+	if (launcher_fd < 0)
+		return;
+	// The launcher exits once its end of the socket is closed
+	launcher_io.disconnect();
+	close(launcher_fd);
+	launcher_fd = -1;
+	// We won't hear about these anymore
+	for (std::map<guint32, Job>::iterator i = launcher_jobs.begin(); i != launcher_jobs.end(); i++)
+		job_done(i->second.owner);
+	launcher_jobs.clear();
+}
+
+static void reply(int fd, guint32 id, int type, int value, gint64 latency) {
+	LauncherReply r;
+	r.id = id;
+	r.type = type;
+	r.value = value;
+	r.latency = latency;
+	send(fd, &r, sizeof(r), MSG_NOSIGNAL);
+}
+
+void run_launcher(int fd) {
+	// The socket was inherited across exec, don't hand it on to commands
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	signal(SIGINT, SIG_IGN);
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, nullptr);
+	int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+	std::map<pid_t, guint32> jobs;
+	static char buf[MAX_MESSAGE+1];
+	for (;;) {
+		struct pollfd pfd[2] = { { fd, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+		if (poll(pfd, 2, -1) == -1)
+			continue;
+		if (pfd[1].revents & POLLIN) {
+			struct signalfd_siginfo si;
+			while (read(sfd, &si, sizeof(si)) == sizeof(si));
+			int status;
+			pid_t pid;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				std::map<pid_t, guint32>::iterator i = jobs.find(pid);
+				if (i == jobs.end())
+					continue;
+				reply(fd, i->second, LAUNCHER_EXITED, status, 0);
+				jobs.erase(i);
+			}
+		}
+		if (!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+		ssize_t n = recv(fd, buf, MAX_MESSAGE, 0);
+		if (n <= 0)
+			exit(EXIT_SUCCESS);
+		if (n < (ssize_t)sizeof(guint32))
+			continue;
+		buf[n] = '\0';
+		guint32 id;
+		memcpy(&id, buf, sizeof(id));
+		const char *cmd = buf + sizeof(id);
+		std::vector<const char *> extra;
+		for (const char *p = cmd + strlen(cmd) + 1; p < buf + n; p += strlen(p) + 1)
+			extra.push_back(p);
+		gint64 start = g_get_monotonic_time();
+		int pid = spawn_sh(cmd, extra);
+		reply(fd, id, LAUNCHER_STARTED, pid, g_get_monotonic_time() - start);
+		if (pid > 0)
+			jobs[pid] = id;
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __SPAWN_H__
+#define __SPAWN_H__
+#include <string>
+#include <vector>
+
+// Run cmd through /bin/sh with the given "NAME=value" strings added to the
+// environment.  Uses posix_spawn, so that the cost doesn't depend on our
+// own size, or hands the command to the launcher process if there is one.
+// Children are reaped from the main loop.  Commands started on behalf of
+// the same owner (an action) are not started again if the last one was
+// started less than debounce ms ago or if max_running of them are still
+// running (0 meaning no limit).
+void spawn_command(const std::string &cmd, const std::vector<std::string> &env,
+		const void *owner = nullptr, int max_running = 0, int debounce = 0);
+
+// Start a small helper process that spawns commands on our behalf
+void start_launcher();
+void stop_launcher();
+
+// Entry point of the helper, never returns
+void run_launcher(int fd);
+
+#endif
@@ -16,12 +16,13 @@
 #include "win.h"
 #include "actiondb.h"
 #include "main.h"
+#include "spawn.h"
+#include "matrix.h"
+#include "unpremultiply.h"
 #include <iomanip>
 #include <glibmm/i18n.h>
-#include <sys/time.h>
 
-Stats::Stats() {
-	Gtk::Button *button_matrix;
+Stats::Stats() : matrix(nullptr) {
 	widgets->get_widget("button_matrix", button_matrix);
 	widgets->get_widget("treeview_recent", recent_view);
 	widgets->get_widget("treeview_ranking", ranking_view);
@@ -30,26 +31,56 @@ Stats::Stats() {
 
 	recent_store = Gtk::ListStore::create(cols);
 	recent_view->set_model(recent_store);
-	recent_view->append_column(_("Stroke"), cols.stroke);
+	append_stroke_column(recent_view, _("Stroke"), &Stats::on_cell_data_stroke);
 	recent_view->append_column(_("Name"), cols.name);
 	recent_view->append_column(_("Score"), cols.score);
 	recent_view->signal_cursor_changed().connect(sigc::mem_fun(*this, &Stats::on_cursor_changed));
 
 	ranking_view->set_model(Gtk::ListStore::create(cols));
-	ranking_view->append_column(_("Stroke"), cols.stroke);
+	append_stroke_column(ranking_view, _("Stroke"), &Stats::on_cell_data_stroke);
 	if (verbosity >= 4)
 		ranking_view->append_column("Debug", cols.debug);
 	ranking_view->append_column(_("Name"), cols.name);
 	ranking_view->append_column(_("Score"), cols.score);
 }
 
+void Stats::append_stroke_column(Gtk::TreeView *view, const Glib::ustring &title,
+		void (Stats::*func)(Gtk::CellRenderer *, const Gtk::TreeModel::iterator &)) {
+	Gtk::CellRendererPixbuf *renderer = Gtk::manage(new Gtk::CellRendererPixbuf);
+	int n = view->append_column(title, *renderer);
+	view->get_column(n-1)->set_cell_data_func(*renderer, sigc::mem_fun(*this, func));
+}
+
+void Stats::on_cell_data_stroke(Gtk::CellRenderer *cell, const Gtk::TreeModel::iterator &iter) {
+	Gtk::CellRendererPixbuf *renderer = dynamic_cast<Gtk::CellRendererPixbuf *>(cell);
+	RStroke s = (*iter)[cols.stroke];
+	if (renderer)
+		renderer->property_pixbuf() = s ? s->draw(STROKE_SIZE) : Glib::RefPtr<Gdk::Pixbuf>();
+}
+
 void Stats::on_cursor_changed() {
 	Gtk::TreePath path;
 	Gtk::TreeViewColumn *col;
 	recent_view->get_cursor(path, col);
 	Gtk::TreeRow row(*recent_store->get_iter(path));
 
+	// The candidates are only looked up once someone wants to see them
 	Glib::RefPtr<Gtk::ListStore> ranking_store = row[cols.child];
+	if (!ranking_store) {
+		ranking_store = Gtk::ListStore::create(cols);
+		row[cols.child] = ranking_store;
+		RRanking r = row[cols.ranking];
+		std::vector<Ranking::Entry> candidates;
+		r->get_candidates(candidates);
+		for (std::vector<Ranking::Entry>::iterator i = candidates.begin(); i != candidates.end(); i++) {
+			Gtk::TreeModel::Row row2 = *(ranking_store->append());
+			row2[cols.stroke] = i->stroke;
+			if (verbosity >= 4)
+				row2[cols.debug] = Stroke::drawDebug(r->stroke, i->stroke, STROKE_SIZE);
+			row2[cols.name] = i->name;
+			row2[cols.score] = format_float(i->score * 100) + "%";
+		}
+	}
 	ranking_view->set_model(ranking_store);
 }
 
@@ -148,7 +179,6 @@ Glib::ustring format_float(float x) {
 }
 
 Glib::RefPtr<Gdk::Pixbuf> Stroke::drawDebug(RStroke a, RStroke b, int size) {
-	// TODO: This is copy'n'paste from win.cc
 	Glib::RefPtr<Gdk::Pixbuf> pb = drawEmpty_(size);
 	if (!a || !b || !a->stroke || !b->stroke)
 		return pb;
@@ -181,33 +211,17 @@ Glib::RefPtr<Gdk::Pixbuf> Stroke::drawDebug(RStroke a, RStroke b, int size) {
 			break;
 	}
 	ctx->stroke();
-
-	for (int i = 0; i < w; i++) {
-		guint8 *px = row;
-		for (int j = 0; j < h; j++) {
-			guint8 a = px[3];
-			guint8 r = px[2];
-			guint8 g = px[1];
-			guint8 b = px[0];
-			if (a) {
-				px[0] = ((((guint)r) << 8) - r) / a;
-				px[1] = ((((guint)g) << 8) - g) / a;
-				px[2] = ((((guint)b) << 8) - b) / a;
-			}
-			px += 4;
-		}
-		row += stride;
-	}
+	surface->flush();
+	unpremultiply(row, w, h, stride);
 	return pb;
 }
 
 bool Stats::on_stroke(RRanking r) {
 	Gtk::TreeModel::Row row = *(recent_store->prepend());
-	row[cols.stroke] = r->stroke->draw(STROKE_SIZE);
+	row[cols.stroke] = r->stroke;
 	row[cols.name] = r->name;
 	row[cols.score] = format_float(r->score*100) + "%";
-	Glib::RefPtr<Gtk::ListStore> ranking_store = Gtk::ListStore::create(cols);
-	row[cols.child] = ranking_store;
+	row[cols.ranking] = r;
 
 	Gtk::TreePath path = recent_store->get_path(row);
 	recent_view->scroll_to_row(path);
@@ -219,69 +233,51 @@ bool Stats::on_stroke(RRanking r) {
 		recent_store->erase(last);
 
 	}
-
-	for (std::multimap<double, std::pair<std::string, RStroke> >::iterator i = r->r.begin(); i != r->r.end(); i++) {
-		Gtk::TreeModel::Row row2 = *(ranking_store->prepend());
-		row2[cols.stroke] = i->second.second->draw(STROKE_SIZE);
-		if (verbosity >= 4)
-			row2[cols.debug] = Stroke::drawDebug(r->stroke, i->second.second, STROKE_SIZE);
-		row2[cols.name] = i->second.first;
-		row2[cols.score] = format_float(i->first * 100) + "%";
-	}
 	return false;
 }
 
 void Stats::on_pdf() {
-	struct timeval tv1, tv2;
-	if (verbosity >= 1)
-		gettimeofday(&tv1, 0);
-	const int S = 32;
-	const int B = 1;
+	if (matrix)
+		return;
+	Gtk::FileChooserDialog dialog(win->get_window(), _("Save Matrix"), Gtk::FILE_CHOOSER_ACTION_SAVE);
+	dialog.add_button(Gtk::Stock::CANCEL, Gtk::RESPONSE_CANCEL);
+	dialog.add_button(Gtk::Stock::SAVE, Gtk::RESPONSE_OK);
+	dialog.set_do_overwrite_confirmation();
+	dialog.set_current_folder(Glib::get_tmp_dir());
+	dialog.set_current_name("strokes.pdf");
+	Glib::RefPtr<Gtk::FileFilter> filter = Gtk::FileFilter::create();
+	filter->set_name(_("PDF, CSV or binary (*.pdf, *.csv, *.bin)"));
+	filter->add_pattern("*.pdf");
+	filter->add_pattern("*.csv");
+	filter->add_pattern("*.bin");
+	dialog.add_filter(filter);
+	if (dialog.run() != Gtk::RESPONSE_OK)
+		return;
+	dialog.hide();
+
 	std::list<RStroke> strokes;
 	actions.get_root()->all_strokes(strokes);
-	const int n = strokes.size();
-	Cairo::RefPtr<Cairo::PdfSurface> surface = Cairo::PdfSurface::create("/tmp/strokes.pdf", (n+1)*S, (n+1)*S);
-	const Cairo::RefPtr<Cairo::Context> ctx = Cairo::Context::create(surface);
-	int k = 1;
-	for (std::list<RStroke>::iterator i = strokes.begin(); i != strokes.end(); i++, k++) {
-		(*i)->draw(surface, k*S+B, B, S-2*B, S-2*B);
-		(*i)->draw(surface, B, k*S+B, S-2*B, S-2*B);
-
-		ctx->set_source_rgba(0,0,0,1);
-		ctx->set_line_width(1);
-		ctx->move_to(k*S, B);
-		ctx->line_to(k*S, (n+1)*S-B);
-		ctx->move_to(B, k*S);
-		ctx->line_to((n+1)*S-B, k*S);
-		ctx->stroke();
-
-		int l = 1;
-		for (std::list<RStroke>::iterator j = strokes.begin(); j != strokes.end(); j++, l++) {
-			double score;
-		        int match = Stroke::compare(*i, *j, score);
-			if (match < 0)
-				continue;
-			if (match) {
-				ctx->save();
-				ctx->set_source_rgba(0,0,1,score-0.6);
-				ctx->rectangle(l*S, k*S, S, S);
-				ctx->fill();
-				ctx->restore();
-			}
-			Glib::ustring str = format_float(score);
-			Cairo::TextExtents te;
-			ctx->get_text_extents(str, te);
-			ctx->move_to(l*S+S/2 - te.x_bearing - te.width/2, k*S+S/2 - te.y_bearing - te.height/2);
-			ctx->show_text(str);
-		}
-	}
-	if (verbosity >= 1) {
-		gettimeofday(&tv2, 0);
-		printf("creating table took %ld us\n", (tv2.tv_sec - tv1.tv_sec)*1000000 + tv2.tv_usec - tv1.tv_usec);
-	}
-	if (!fork()) {
-		execlp("xdg-open", "xdg-open", "/tmp/strokes.pdf", nullptr);
-		exit(EXIT_FAILURE);
+	try {
+		matrix = new MatrixJob(strokes, dialog.get_filename(),
+				sigc::mem_fun(*this, &Stats::on_matrix_progress),
+				sigc::mem_fun(*this, &Stats::on_matrix_finished));
+	} catch (std::exception &e) {
+		printf("Error: Couldn't create %s: %s\n", dialog.get_filename().c_str(), e.what());
+		return;
 	}
+	button_matrix->set_sensitive(false);
 }
 
+void Stats::on_matrix_progress(int done, int total) {
+	int percent = total ? 100*(gint64)done/total : 100;
+	button_matrix->set_label(_("_Matrix") + Glib::ustring::compose(" (%1", percent) + "%)");
+}
+
+void Stats::on_matrix_finished(bool ok) {
+	button_matrix->set_label(_("_Matrix"));
+	button_matrix->set_sensitive(true);
+	if (ok && matrix->get_format() == MatrixJob::PDF)
+		spawn_command("xdg-open " + Glib::shell_quote(matrix->get_filename()), std::vector<std::string>());
+	delete matrix;
+	matrix = nullptr;
+}
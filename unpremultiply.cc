@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2008-2009, Thomas Jaeger <ThJaeger@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "unpremultiply.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 255/a in 16.16 fixed point
+static struct UnpremultiplyTable {
+	guint32 t[256];
+	UnpremultiplyTable() {
+		t[0] = 0;
+		for (int a = 1; a < 256; a++)
+			t[a] = (255*65536 + a/2) / a;
+	}
+} unpremultiply_table;
+
+static inline void unpremultiply_pixel(guint8 *px) {
+	guint8 a = px[3];
+	if (!a)
+		return;
+	guint32 f = unpremultiply_table.t[a];
+	guint32 r = (px[2]*f + 0x8000) >> 16;
+	guint32 g = (px[1]*f + 0x8000) >> 16;
+	guint32 b = (px[0]*f + 0x8000) >> 16;
+	px[0] = r > 255 ? 255 : r;
+	px[1] = g > 255 ? 255 : g;
+	px[2] = b > 255 ? 255 : b;
+}
+
+// Converts cairo's premultiplied ARGB32 into GdkPixbuf's RGBA in place.
+// Most of a stroke picture is either fully transparent or fully opaque,
+// the SSE2 path handles runs of four such pixels without any arithmetic.
+void unpremultiply(guint8 *row, int w, int h, int stride) {
+	for (int y = 0; y < h; y++, row += stride) {
+		int x = 0;
+#ifdef __SSE2__
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		const __m128i green = _mm_set1_epi32(0xff00ff00);
+		const __m128i low = _mm_set1_epi32(0x000000ff);
+		for (; x + 4 <= w; x += 4) {
+			__m128i *p = (__m128i *)(row + 4*x);
+			__m128i px = _mm_loadu_si128(p);
+			__m128i a = _mm_and_si128(px, alpha);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_setzero_si128())) == 0xffff)
+				continue;
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha)) == 0xffff) {
+				__m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), low);
+				__m128i b = _mm_slli_epi32(_mm_and_si128(px, low), 16);
+				_mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(px, green), _mm_or_si128(r, b)));
+				continue;
+			}
+			for (int i = 0; i < 4; i++)
+				unpremultiply_pixel(row + 4*(x+i));
+		}
+#endif
+		for (; x < w; x++)
+			unpremultiply_pixel(row + 4*x);
+	}
+}
+
+void unpremultiply_scalar(guint8 *row, int w, int h, int stride) {
+	for (int y = 0; y < h; y++, row += stride)
+		for (int x = 0; x < w; x++)
+			unpremultiply_pixel(row + 4*x);
+}
@@ -17,6 +17,9 @@
 #define __VAR_H__
 
 #include <set>
+#include <vector>
+#include <algorithm>
+#include <climits>
 #include <boost/shared_ptr.hpp>
 #include <glibmm.h>
 #include "util.h"
@@ -24,6 +27,10 @@
 class Base {
 public:
 	virtual void notify() = 0;
+	// Notifications are delivered in order of increasing level, so that a
+	// computed value is only recomputed after all of its inputs are.  Plain
+	// observers go last.
+	virtual int level() const { return INT_MAX; }
 	virtual ~Base() {}
 };
 
@@ -34,26 +41,51 @@ public:
 	virtual void notify() { f(); }
 };
 
+// Changes made while an Atomic is alive are propagated when the outermost
+// one goes away, each subscriber being notified at most once
 class Atomic {
-	std::set<Base *> update_queue;
+	static int depth;
+	static std::vector<Base *> queue;
 public:
-	void defer(Base *out) { update_queue.insert(out); }
+	Atomic() { depth++; }
+	static bool active() { return depth; }
+	static void defer(Base *out) {
+		if (std::find(queue.begin(), queue.end(), out) == queue.end())
+			queue.push_back(out);
+	}
 	~Atomic() {
-		for (std::set<Base *>::iterator i = update_queue.begin(); i != update_queue.end(); i++)
-			(*i)->notify();
+		if (depth > 1) {
+			depth--;
+			return;
+		}
+		while (!queue.empty()) {
+			std::vector<Base *>::iterator min = queue.begin();
+			for (std::vector<Base *>::iterator i = queue.begin(); i != queue.end(); i++)
+				if ((*i)->level() < (*min)->level())
+					min = i;
+			Base *b = *min;
+			queue.erase(min);
+			b->notify();
+		}
+		depth--;
 	}
 };
 
 template <class T> class Out {
-	std::set<Base *> out;
+	std::vector<Base *> out;
 protected:
 	void update() {
-		for (std::set<Base *>::iterator i = out.begin(); i != out.end(); i++)
-			(*i)->notify();
+		Atomic a;
+		for (std::vector<Base *>::iterator i = out.begin(); i != out.end(); i++)
+			Atomic::defer(*i);
 	}
 public:
-	void connect(Base *s) { out.insert(s); }
+	void connect(Base *s) {
+		if (std::find(out.begin(), out.end(), s) == out.end())
+			out.push_back(s);
+	}
 	virtual T get() const = 0;
+	virtual int level() const { return 0; }
 	virtual ~Out() {}
 };
 
@@ -71,6 +103,8 @@ public:
 	Source() {}
 	Source(T x_) : x(x_) {}
 	virtual void set(const T x_) {
+		if (x == x_)
+			return;
 		x = x_;
 		Out<T>::update();
 	}
@@ -82,6 +116,7 @@ public:
 		return x;
 	}
 	virtual void notify() { Out<T>::update(); }
+	virtual int level() const { return 0; }
 	// unsafe_refs even more so
 	T &unsafe_ref() { return x; }
 };
@@ -93,19 +128,31 @@ public:
 	Var(Out<T> &in_) : in(in_), x(in.get()) { in.connect(this); }
 	virtual void notify() { set(in.get()); }
 	virtual void set(const T x_) {
+		if (x == x_)
+			return;
 		x = x_;
 		Out<T>::update();
 	}
 	virtual T get() const { return x; }
+	virtual int level() const { return in.level() + 1; }
 };
 
+// Computed values are cached, subscribers only hear about actual changes
 template <class X, class Y> class Fun : public Out<Y>, private Base {
 	sigc::slot<Y, X> f;
 	Out<X> &in;
+	Y y;
 public:
-	Fun(sigc::slot<Y, X> f_, Out<X> &in_) : f(f_), in(in_) { in.connect(this); }
-	virtual Y get() const { return f(in.get()); }
-	virtual void notify() { Out<Y>::update(); }
+	Fun(sigc::slot<Y, X> f_, Out<X> &in_) : f(f_), in(in_), y(f(in.get())) { in.connect(this); }
+	virtual Y get() const { return y; }
+	virtual void notify() {
+		Y y_ = f(in.get());
+		if (y == y_)
+			return;
+		y = y_;
+		Out<Y>::update();
+	}
+	virtual int level() const { return in.level() + 1; }
 };
 
 template <class X, class Y> Fun<X, Y> *fun(Y (*f)(X), Out<X> &in) {
@@ -116,13 +163,21 @@ template <class X, class Y, class Z> class Fun2 : public Out<Z>, private Base {
 	sigc::slot<Z, X, Y> f;
 	Out<X> &inX;
 	Out<Y> &inY;
+	Z z;
 public:
-	Fun2(sigc::slot<Z, X, Y> f_, Out<X> &inX_, Out<Y> &inY_) : f(f_), inX(inX_), inY(inY_) {
+	Fun2(sigc::slot<Z, X, Y> f_, Out<X> &inX_, Out<Y> &inY_) : f(f_), inX(inX_), inY(inY_), z(f(inX.get(), inY.get())) {
 		inX.connect(this);
 		inY.connect(this);
 	}
-	virtual Z get() const { return f(inX.get(), inY.get()); }
-	virtual void notify() { Out<Z>::update(); }
+	virtual Z get() const { return z; }
+	virtual void notify() {
+		Z z_ = f(inX.get(), inY.get());
+		if (z == z_)
+			return;
+		z = z_;
+		Out<Z>::update();
+	}
+	virtual int level() const { return std::max(inX.level(), inY.level()) + 1; }
 };
 
 template <class X1, class X2, class Y> Fun2<X1, X2, Y> *fun2(Y (*f)(X1, X2), Out<X1> &in1, Out<X2> &in2) {
@@ -140,6 +195,7 @@ public:
 	virtual Y get() const { return f(in.get()); }
 	virtual void notify() { Out<Y>::update(); }
 	virtual void set(const Y y) { in.set(g(y)); }
+	virtual int level() const { return in.level() + 1; }
 };
 
 class Watcher : private Base {
@@ -17,10 +17,66 @@
 #include "prefs.h"
 #include "win.h"
 #include "main.h"
+#include "unpremultiply.h"
 #include <glibmm/i18n.h>
+#include <list>
+#include <unordered_map>
 
 Glib::RefPtr<Gtk::Builder> widgets;
 
+// All stroke thumbnails go through this cache, which throws out the least
+// recently used ones once they take up more than THUMBNAIL_BUDGET bytes.
+#define THUMBNAIL_BUDGET (4 << 20)
+
+class ThumbnailCache {
+	struct Key {
+		unsigned int id;
+		int size;
+		double width;
+		bool inv;
+		bool operator==(const Key &k) const {
+			return id == k.id && size == k.size && width == k.width && inv == k.inv;
+		}
+	};
+	struct Hash {
+		size_t operator()(const Key &k) const {
+			return k.id * 31u + k.size * 7u + (size_t)(k.width * 4.0) * 3u + k.inv;
+		}
+	};
+	typedef std::list<std::pair<Key, Glib::RefPtr<Gdk::Pixbuf> > > List;
+	List lru; // most recently used first
+	std::unordered_map<Key, List::iterator, Hash> index;
+	size_t bytes;
+
+	static size_t size_of(const Glib::RefPtr<Gdk::Pixbuf> &pb) { return pb->get_rowstride() * pb->get_height(); }
+public:
+	ThumbnailCache() : bytes(0) {}
+	Glib::RefPtr<Gdk::Pixbuf> get(const Stroke &s, int size, double width, bool inv) {
+		Key k = { s.get_id(), size, width, inv };
+		std::unordered_map<Key, List::iterator, Hash>::iterator i = index.find(k);
+		if (i != index.end()) {
+			lru.splice(lru.begin(), lru, i->second);
+			return i->second->second;
+		}
+		Glib::RefPtr<Gdk::Pixbuf> pb = s.draw_(size, width, inv);
+		lru.push_front(std::make_pair(k, pb));
+		index[k] = lru.begin();
+		bytes += size_of(pb);
+		while (bytes > THUMBNAIL_BUDGET && lru.size() > 1) {
+			bytes -= size_of(lru.back().second);
+			index.erase(lru.back().first);
+			lru.pop_back();
+		}
+		return pb;
+	}
+};
+
+static ThumbnailCache thumbnails;
+
+Glib::RefPtr<Gdk::Pixbuf> Stroke::draw(int size, double width, bool inv) const {
+	return thumbnails.get(*this, size, width, inv);
+}
+
 void Stroke::draw(Cairo::RefPtr<Cairo::Surface> surface, int x, int y, int w, int h, double width, bool inv) const {
 	const Cairo::RefPtr<Cairo::Context> ctx = Cairo::Context::create (surface);
 	x += width; y += width; w -= 2*width; h -= 2*width;
@@ -119,26 +175,11 @@ Glib::RefPtr<Gdk::Pixbuf> Stroke::draw_(int size, double width, bool inv) const
 	// http://www.archivum.info/gtkmm-list@gnome.org/2007-05/msg00112.html
 	Cairo::RefPtr<Cairo::ImageSurface> surface = Cairo::ImageSurface::create(row, Cairo::FORMAT_ARGB32, w, h, stride);
 	draw(surface, 0, 0, pb->get_width(), size, width, inv);
-	for (int i = 0; i < w; i++) {
-		guint8 *px = row;
-		for (int j = 0; j < h; j++) {
-			guint8 a = px[3];
-			guint8 r = px[2];
-			guint8 g = px[1];
-			guint8 b = px[0];
-			if (a) {
-				px[0] = ((((guint)r) << 8) - r) / a;
-				px[1] = ((((guint)g) << 8) - g) / a;
-				px[2] = ((((guint)b) << 8) - b) / a;
-			}
-			px += 4;
-		}
-		row += stride;
-	}
+	surface->flush();
+	unpremultiply(row, w, h, stride);
 	return pb;
 }
 
-
 Glib::RefPtr<Gdk::Pixbuf> Stroke::drawEmpty_(int size) {
 	Glib::RefPtr<Gdk::Pixbuf> pb = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB,true,8,size,size);
 	pb->fill(0x00000000);
@@ -262,7 +303,7 @@ void Win::hide() {
 
 bool Win::on_icon_size_changed(int size) {
 	icon_pb[0] = Stroke::trefoil()->draw(size);
-	icon_pb[1] = Stroke::trefoil()->draw(size);
+	icon_pb[1] = icon_pb[0]->copy();
 	icon_pb[1]->saturate_and_pixelate(icon_pb[1], 0.0, true);
 	if (icon)
 		icon->set(icon_pb[disabled.get() ? 1 : 0]);
@@ -24,6 +24,7 @@ class Actions;
 class Prefs;
 class Stats;
 class Ranking;
+class MatrixJob;
 
 // Convenience macro for on-the-fly creation of widgets
 #define WIDGET(TYPE, NAME, ARGS...) TYPE &NAME = *Gtk::manage(new TYPE(ARGS))
@@ -66,16 +67,25 @@ public:
 	bool on_stroke(boost::shared_ptr<Ranking>);
 private:
 	void on_pdf();
+	void on_matrix_progress(int done, int total);
+	void on_matrix_finished(bool ok);
 	void on_cursor_changed();
+	void append_stroke_column(Gtk::TreeView *view, const Glib::ustring &title,
+			void (Stats::*func)(Gtk::CellRenderer *, const Gtk::TreeModel::iterator &));
+	void on_cell_data_stroke(Gtk::CellRenderer *cell, const Gtk::TreeModel::iterator &iter);
 
+	// Only the strokes are stored, the pictures are drawn when a row is
+	// actually displayed.  The debug pictures (verbosity 4) are drawn once,
+	// along with the list of candidates.
 	class ModelColumns : public Gtk::TreeModel::ColumnRecord {
 	public:
-		ModelColumns() { add(stroke); add(debug); add(name); add(score); add(child); }
+		ModelColumns() { add(stroke); add(debug); add(name); add(score); add(ranking); add(child); }
 
-		Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf> > stroke;
+		Gtk::TreeModelColumn<RStroke> stroke;
 		Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf> > debug;
 		Gtk::TreeModelColumn<Glib::ustring> name;
 		Gtk::TreeModelColumn<Glib::ustring> score;
+		Gtk::TreeModelColumn<boost::shared_ptr<Ranking> > ranking;
 		Gtk::TreeModelColumn<Glib::RefPtr<Gtk::ListStore> > child;
 	};
 	ModelColumns cols;
@@ -84,6 +94,9 @@ private:
 	Glib::RefPtr<Gtk::ListStore> recent_store;
 
 	Gtk::TreeView *ranking_view;
+
+	Gtk::Button *button_matrix;
+	MatrixJob *matrix;
 };
 
 class SelectButton {